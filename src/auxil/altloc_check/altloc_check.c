@@ -2,6 +2,7 @@
 
 Purpose: output 0 or 1 if a pdb file does or doesn't contain altLoc identifiers
 NOTE: - only uses ^ATOM records
+      - the pdb file on STDIN may be gzip compressed
 
 
 Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
@@ -33,17 +34,30 @@ along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
 #include<math.h>
 #include<string.h>
 
+#include "pdbrecord.h"
 
-#define MAXLINELENGTH 80
 
-int checkaltloc( void ) ;
+int checkaltloc( pdbreader_t *fp ) ;
 
 
 int main(int argc, char *argv[])
 {
 
    int answer ;
-   answer = checkaltloc() ;
+   pdbreader_t *fp ;
+
+   fp = pdb_fdopen(fileno(stdin), 0) ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: can not read STDIN\n") ;
+      exit(1) ;
+   }
+
+   answer = checkaltloc(fp) ;
+   if (pdb_error(fp) != NULL) {
+      fprintf(stderr, "ERROR: can not read STDIN: %s\n", pdb_error(fp)) ;
+      exit(1) ;
+   }
+   pdb_close(fp) ;
    printf("%d\n", answer) ;
 
    return 0;
@@ -55,10 +69,10 @@ int main(int argc, char *argv[])
    readinatoms)_t struct with a pointer to an array of atom_t structs,
    the number of atoms, and the coordinate minimum and maximum along each
    dimension*/
-int checkaltloc(void)
+int checkaltloc(pdbreader_t *fp)
 {
-   char line[MAXLINELENGTH] ;
-   char tempsubstr[2] ;
+   const char *line ;
+   int len ;
 
    int i, j, uses_altloc ;
 
@@ -66,32 +80,17 @@ int checkaltloc(void)
    i = 0;
    j = 1;
    uses_altloc = 0;
-   while ((fgets(line, sizeof(line), stdin)) &&
-          (! uses_altloc) &&
-	  j) {
-
-      *(line+(strlen(line)-1)) = '\0';
-
-      if ((line[0] == 'A') &&
-          (line[1] == 'T') &&
-          (line[2] == 'O') &&
-          (line[3] == 'M')) {
+   while ((! uses_altloc) && j && pdb_nextline(fp, &line, &len)) {
 
-         strncpy(tempsubstr, (line + 16), 1) ;
-         tempsubstr[1] = '\0' ;
+      if (pdb_is_atom(line, len)) {
 
-	 if (tempsubstr[0] != ' ') {
+	 if (pdb_char(line, len, PDB_ALTLOC) != ' ') {
 //	    fprintf(stderr,"uses altloc on atom %d\n", i) ;
 	    uses_altloc = 1 ; }
       
          i++ ;
 
-      } else if ( (line[0] == 'E') &&
-                (line[1] == 'N') &&
-                (line[2] == 'D') &&
-                (line[3] == 'M') &&
-                (line[4] == 'D') &&
-                (line[5] == 'L') ) {
+      } else if (pdb_is_endmdl(line, len)) {
 
 	 j = 0 ;
 
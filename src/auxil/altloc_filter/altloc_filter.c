@@ -0,0 +1,476 @@
+/* altloc_filter.c - Filters alternate locations out of a PDB file
+
+Purpose: filter PDB file to leave only highest occupancy, or first instance
+         of atoms with ALTLOC flags set
+Usage: ./altloc_filter pdbfile > filtered pdbfile
+
+C implementation of altloc_filter.pl, whose output it reproduces byte for
+byte: two ATOM or HETATM records are the same atom if they agree in record
+name, atom name, residue name, chain id, residue number and insertion code
+(columns 1-6, 13-16, 18-20 and 22-27). Of each atom only the record with
+the highest occupancy, read from columns 56-61 as the perl script does, or
+else the first one is kept, with its altLoc (column 17) blanked. All other
+lines are passed through.
+
+As in the perl script, a later record of an atom can still beat an earlier
+one, so the file is read twice: once to pick the record kept for every
+atom, and once to print. No lines are held in memory, only one entry per
+distinct atom.
+
+NOTE: - the pdb file may be gzip compressed
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+*/
+
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<math.h>
+#include<string.h>
+#include<strings.h>
+#include<zlib.h>
+
+
+//#define DEBUG 1
+#define INITLINELENGTH 256
+#define INPUTBUFSIZE 262144
+#define INITNUMSIGS 4096
+#define SIGLENGTH 19            // 6 + 4 + 3 + 6 columns
+#define ALTLOCCOL 16
+#define OCCUPCOL 55             // altloc_filter.pl reads substr($line, 55, 6)
+#define OCCUPWIDTH 6
+
+
+//STRUCTURES
+
+/* a line of the input, with its newline if it has one */
+struct pdbline_Struct {
+   char		*line ;
+   size_t	len ;
+   size_t	size ;
+} ;
+typedef struct pdbline_Struct pdbline_t ;
+
+
+/* an atom: its signature, and the line and occupancy of the record kept so
+   far; siglen 0 marks an empty slot */
+struct atomsig_Struct {
+   char		sig[SIGLENGTH] ;
+   unsigned char	siglen ;
+   long		linenum ;
+   double	occup ;
+} ;
+typedef struct atomsig_Struct atomsig_t ;
+
+
+/* open addressing hash of atom signatures */
+struct sigtable_Struct {
+   long		number ;
+   long		size ;		// slots, a power of two
+   atomsig_t	*details ;
+} ;
+typedef struct sigtable_Struct sigtable_t ;
+
+
+
+//FUNCTION DECLARATION
+#define Error( Str )   fprintf( stderr, "%s\n", Str ), exit( 1 )
+
+int readline( gzFile fp, pdbline_t *pdbline ) ;
+int is_atomrecord( const char *line, size_t len ) ;
+int atomsig( const char *line, size_t len, char *sig ) ;
+double occupancy( const char *line, size_t len ) ;
+double perl_numify( const char *s, size_t len ) ;
+sigtable_t *new_sigtable( void ) ;
+atomsig_t *lookup_sig( sigtable_t *sigs, const char *sig, int siglen, int insert ) ;
+void findkeepers( gzFile fp, sigtable_t *sigs ) ;
+void printkeepers( gzFile fp, sigtable_t *sigs ) ;
+
+
+
+int main(int argc, char *argv[])
+{
+   char *pdb_fn ;
+   gzFile pdb_fp ;
+   sigtable_t *sigs ;
+
+   if (argc > 1 ) {
+      pdb_fn = argv[1] ;
+   } else {
+      Error("usage: altloc_filter pdbfile");
+   }
+
+
+   pdb_fp = gzopen(pdb_fn, "rb") ;
+   if (pdb_fp == NULL) {
+      fprintf(stderr, "ERROR: PDB file %s does not exist\n", pdb_fn) ;
+      exit(1) ;
+   }
+   gzbuffer(pdb_fp, INPUTBUFSIZE) ;
+
+   sigs = new_sigtable() ;
+   findkeepers(pdb_fp, sigs) ;
+
+#ifdef DEBUG
+   fprintf(stderr, "read %ld distinct atoms\n", sigs->number) ;
+#endif
+
+   if (gzrewind(pdb_fp) != 0) {
+      fprintf(stderr, "ERROR: can not reread PDB file %s\n", pdb_fn) ;
+      exit(1) ;
+   }
+
+   printkeepers(pdb_fp, sigs) ;
+   gzclose(pdb_fp) ;
+
+   return 0;
+}
+
+
+
+/* findkeepers: reads every ATOM and HETATM record and leaves in sigs the
+   line of the record kept for each atom: the first one, unless a later
+   one has a strictly higher occupancy */
+void findkeepers( gzFile fp, sigtable_t *sigs )
+{
+   pdbline_t pdbline = {NULL, 0, 0} ;
+   char sig[SIGLENGTH] ;
+   int siglen ;
+   long linenum ;
+
+   for (linenum = 0; readline(fp, &pdbline); linenum++) {
+      size_t len = pdbline.len ;
+      atomsig_t *atom ;
+      double occup ;
+
+// signatures and occupancies are taken from the line without its newline
+      if ((len > 0) && (pdbline.line[len - 1] == '\n')) {
+         len-- ; }
+
+      if (! is_atomrecord(pdbline.line, len)) {
+         continue ; }
+
+      siglen = atomsig(pdbline.line, len, sig) ;
+      occup = occupancy(pdbline.line, len) ;
+
+      atom = lookup_sig(sigs, sig, siglen, 0) ;
+      if (atom == NULL) {
+         atom = lookup_sig(sigs, sig, siglen, 1) ;
+         atom->linenum = linenum ;
+         atom->occup = occup ;
+
+      } else if (occup > atom->occup) {
+         atom->linenum = linenum ;
+         atom->occup = occup ;
+      }
+   }
+
+   free(pdbline.line) ;
+}
+
+
+
+/* printkeepers: prints every line but the ATOM and HETATM records that were
+   not kept, with the altLoc of the kept ones blanked */
+void printkeepers( gzFile fp, sigtable_t *sigs )
+{
+   pdbline_t pdbline = {NULL, 0, 0} ;
+   char sig[SIGLENGTH] ;
+   int siglen ;
+   long linenum ;
+
+   for (linenum = 0; readline(fp, &pdbline); linenum++) {
+      size_t len = pdbline.len ;
+
+      if ((len > 0) && (pdbline.line[len - 1] == '\n')) {
+         len-- ; }
+
+      if (! is_atomrecord(pdbline.line, len)) {
+         fwrite(pdbline.line, 1, pdbline.len, stdout) ;
+         continue ; }
+
+      siglen = atomsig(pdbline.line, len, sig) ;
+      if (lookup_sig(sigs, sig, siglen, 0)->linenum != linenum) {
+         continue ; }
+
+// the perl script blanks column 17 of the line with its newline: it
+// replaces the newline of a 16 char line, extends a 15 char line ending in
+// one and dies on anything shorter
+      if (pdbline.len > ALTLOCCOL) {
+         pdbline.line[ALTLOCCOL] = ' ' ;
+         fwrite(pdbline.line, 1, pdbline.len, stdout) ;
+
+      } else if (pdbline.len == ALTLOCCOL) {
+         fwrite(pdbline.line, 1, pdbline.len, stdout) ;
+         putchar(' ') ;
+
+      } else {
+         fprintf(stderr, "ERROR: line %ld is too short to blank its altLoc\n",
+                 (linenum + 1)) ;
+         exit(1) ;
+      }
+   }
+
+   free(pdbline.line) ;
+}
+
+
+
+/* readline: reads the next line, of any length, into pdbline; returns 0 at
+   the end of the file, and exits on a truncated or corrupt gzip file */
+int readline( gzFile fp, pdbline_t *pdbline )
+{
+   int errnum ;
+
+   if (pdbline->line == NULL) {
+      pdbline->size = INITLINELENGTH ;
+      pdbline->line = malloc(pdbline->size) ;
+      if (pdbline->line == NULL) {
+         Error("Out of memory on line malloc()\n") ; }
+   }
+
+   pdbline->len = 0 ;
+
+   while (gzgets(fp, (pdbline->line + pdbline->len),
+                 (int) (pdbline->size - pdbline->len)) != NULL) {
+
+      pdbline->len += strlen(pdbline->line + pdbline->len) ;
+
+      if ((pdbline->len > 0) && (pdbline->line[pdbline->len - 1] == '\n')) {
+         return 1 ; }
+
+      if (pdbline->len + 1 == pdbline->size) {
+         char *newp ;
+         pdbline->size *= 2 ;
+         newp = realloc(pdbline->line, pdbline->size) ;
+         if (newp == NULL) {
+            Error("Out of memory on line realloc()\n") ; }
+         pdbline->line = newp ;
+      }
+   }
+
+   gzerror(fp, &errnum) ;
+   if ((errnum != Z_OK) && (errnum != Z_STREAM_END)) {
+      fprintf(stderr, "ERROR: can not read the PDB file: %s\n",
+              gzerror(fp, &errnum)) ;
+      exit(1) ;
+   }
+
+   return (pdbline->len > 0) ;
+}
+
+
+
+/* is_atomrecord: true for lines starting with ATOM or HETATM */
+int is_atomrecord( const char *line, size_t len )
+{
+   return (((len >= 4) && (strncmp(line, "ATOM", 4) == 0)) ||
+           ((len >= 6) && (strncmp(line, "HETATM", 6) == 0))) ;
+}
+
+
+
+/* atomsig: copies the columns that identify an atom into sig and returns
+   their number; as with perl's substr(), fields past the end of a short
+   line are cut short or left out */
+int atomsig( const char *line, size_t len, char *sig )
+{
+   static const int fields[4][2] = {{0, 6}, {12, 4}, {17, 3}, {21, 6}} ;
+   int siglen = 0 ;
+   int k ;
+
+   for (k = 0; k < 4; k++) {
+      size_t col = fields[k][0] ;
+      size_t width = fields[k][1] ;
+
+      if (col >= len) {
+         break ; }
+      if (col + width > len) {
+         width = len - col ; }
+
+      memcpy((sig + siglen), (line + col), width) ;
+      siglen += width ;
+   }
+
+   return siglen ;
+}
+
+
+
+/* occupancy: the value of substr($line, 55, 6) in a perl numeric
+   comparison; 0 if the line is shorter than that */
+double occupancy( const char *line, size_t len )
+{
+   size_t width = OCCUPWIDTH ;
+
+   if (len < OCCUPCOL) {
+      return 0.0 ; }
+   if (OCCUPCOL + width > len) {
+      width = len - OCCUPCOL ; }
+
+   return perl_numify((line + OCCUPCOL), width) ;
+}
+
+
+
+/* perl_numify: converts a string to a number the way perl does: leading
+   whitespace, then the longest decimal number, or an Inf or NaN in one of
+   the spellings perl knows, that starts it; 0 if there is none */
+double perl_numify( const char *s, size_t len )
+{
+   char number[64] ;
+   size_t j = 0 ;
+   size_t start ;
+   size_t numdigits = 0 ;
+   int neg = 0 ;
+
+   while ((j < len) && ((s[j] == ' ') || (s[j] == '\t') || (s[j] == '\n') ||
+                        (s[j] == '\r') || (s[j] == '\f') || (s[j] == '\v'))) {
+      j++ ; }
+
+   if ((j < len) && ((s[j] == '-') || (s[j] == '+'))) {
+      neg = (s[j] == '-') ;
+      j++ ;
+   }
+
+   if ((j + 3 <= len) && (strncasecmp((s + j), "inf", 3) == 0)) {
+      return neg ? -INFINITY : INFINITY ; }
+   if (((j + 3 <= len) && (strncasecmp((s + j), "nan", 3) == 0)) ||
+       ((j + 4 <= len) && ((strncasecmp((s + j), "qnan", 4) == 0) ||
+                           (strncasecmp((s + j), "snan", 4) == 0)))) {
+      return NAN ; }
+
+   start = j ;
+   for (; (j < len) && (s[j] >= '0') && (s[j] <= '9'); j++) {
+      numdigits++ ; }
+
+   if ((j < len) && (s[j] == '.')) {
+      for (j++; (j < len) && (s[j] >= '0') && (s[j] <= '9'); j++) {
+         numdigits++ ; }
+   }
+
+   if (numdigits == 0) {
+      return 0.0 ; }
+
+// the windows forms 1.#INF and 1.#IND
+   if ((j + 4 <= len) && (s[j - 1] == '.') && (s[j] == '#')) {
+      if (strncasecmp((s + j + 1), "INF", 3) == 0) {
+         return neg ? -INFINITY : INFINITY ; }
+      if (strncasecmp((s + j + 1), "IND", 3) == 0) {
+         return NAN ; }
+   }
+
+   if ((j < len) && ((s[j] == 'e') || (s[j] == 'E'))) {
+      size_t e = j + 1 ;
+
+      if ((e < len) && ((s[e] == '-') || (s[e] == '+'))) {
+         e++ ; }
+      if ((e < len) && (s[e] >= '0') && (s[e] <= '9')) {
+         for (j = e; (j < len) && (s[j] >= '0') && (s[j] <= '9'); j++) {
+            ; }
+      }
+   }
+
+   if (j - start >= sizeof(number)) {
+      return 0.0 ; }
+
+   memcpy(number, (s + start), (j - start)) ;
+   number[j - start] = '\0' ;
+
+   return neg ? -strtod(number, NULL) : strtod(number, NULL) ;
+}
+
+
+
+/* new_sigtable: returns an empty signature hash */
+sigtable_t *new_sigtable( void )
+{
+   sigtable_t *sigs ;
+
+   sigs = malloc(sizeof(sigtable_t)) ;
+   if (sigs == NULL) {
+      Error("Out of memory on sigs malloc()\n") ; }
+
+   sigs->number = 0 ;
+   sigs->size = INITNUMSIGS ;
+   sigs->details = calloc(sigs->size, sizeof(atomsig_t)) ;
+   if (sigs->details == NULL) {
+      Error("Out of memory on sigs calloc()\n") ; }
+
+   return sigs ;
+}
+
+
+
+/* lookup_sig: returns the entry of an atom signature, or NULL if it has
+   none; with insert set, a new signature gets an entry */
+atomsig_t *lookup_sig( sigtable_t *sigs, const char *sig, int siglen, int insert )
+{
+   unsigned int hash = 2166136261u ;
+   atomsig_t *atom ;
+   long slot ;
+   int k ;
+
+   for (k = 0; k < siglen; k++) {
+      hash = (hash ^ (unsigned char) sig[k]) * 16777619u ; }
+
+   slot = hash & (sigs->size - 1) ;
+   while (sigs->details[slot].siglen != 0) {
+      atom = &sigs->details[slot] ;
+      if ((atom->siglen == siglen) && (memcmp(atom->sig, sig, siglen) == 0)) {
+         return atom ; }
+      slot = (slot + 1) & (sigs->size - 1) ;
+   }
+
+   if (! insert) {
+      return NULL ; }
+
+   if (2 * (sigs->number + 1) > sigs->size) {
+      atomsig_t *old = sigs->details ;
+      long oldsize = sigs->size ;
+      long j ;
+
+      sigs->size *= 2 ;
+      sigs->number = 0 ;
+      sigs->details = calloc(sigs->size, sizeof(atomsig_t)) ;
+      if (sigs->details == NULL) {
+         Error("Out of memory on sigs calloc()\n") ; }
+
+      for (j = 0; j < oldsize; j++) {
+         if (old[j].siglen != 0) {
+            *lookup_sig(sigs, old[j].sig, old[j].siglen, 1) = old[j] ; }
+      }
+      free(old) ;
+
+      return lookup_sig(sigs, sig, siglen, 1) ;
+   }
+
+   atom = &sigs->details[slot] ;
+   memcpy(atom->sig, sig, siglen) ;
+   atom->siglen = siglen ;
+   sigs->number++ ;
+
+   return atom ;
+}
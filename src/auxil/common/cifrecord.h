@@ -0,0 +1,108 @@
+/* cifrecord.h - Streaming mmCIF (PDBx) tokenizer for the auxil C tools
+
+Description: header-only tokenizer for the lines handed out by a
+pdbreader_t (see pdbrecord.h). It splits a line into CIF tokens in place,
+without building any object model, so that a tool can pick the items of
+the one category it needs (e.g. the _atom_site loop) out of a stream.
+
+Multi-line text fields (lines starting with ';') are left to the caller:
+cif_textfield_line() tells when a line opens or closes one.
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CIFRECORD_H
+#define CIFRECORD_H
+
+#include<string.h>
+
+
+/* cif_is_datablock: true if a line starts a CIF data block */
+static inline int cif_is_datablock( const char *line, int len )
+{
+   return ((len >= 5) && (strncmp(line, "data_", 5) == 0)) ;
+}
+
+
+/* cif_textfield_line: true if a line opens or closes a ;-delimited text
+   field */
+static inline int cif_textfield_line( const char *line, int len )
+{
+   return ((len >= 1) && (line[0] == ';')) ;
+}
+
+
+/* cif_token: finds the next token of line at or after *pos, sets *tok and
+   *toklen and moves *pos past it; returns 0 at the end of the line or at a
+   comment. Quoted tokens are returned without their quotes and *quoted is
+   set, so that a quoted '.' or '_x' can be told from a null or a tag */
+static inline int cif_token( const char *line, int len, int *pos, const char **tok, int *toklen, int *quoted )
+{
+   int j = *pos ;
+   int start ;
+
+   while ((j < len) && ((line[j] == ' ') || (line[j] == '\t') || (line[j] == '\r'))) {
+      j++ ; }
+
+   if ((j >= len) || (line[j] == '#')) {
+      *pos = len ;
+      return 0 ;
+   }
+
+   if ((line[j] == '\'') || (line[j] == '"')) {
+      char q = line[j] ;
+
+// a quote only closes the token if whitespace or the end of line follows
+      start = ++j ;
+      while ((j < len) &&
+             ((line[j] != q) ||
+              ((j + 1 < len) && (line[j + 1] != ' ') && (line[j + 1] != '\t') &&
+               (line[j + 1] != '\r')))) {
+         j++ ; }
+
+      *tok = line + start ;
+      *toklen = j - start ;
+      *quoted = 1 ;
+      *pos = (j < len) ? (j + 1) : len ;
+      return 1 ;
+   }
+
+   start = j ;
+   while ((j < len) && (line[j] != ' ') && (line[j] != '\t') && (line[j] != '\r')) {
+      j++ ; }
+
+   *tok = line + start ;
+   *toklen = j - start ;
+   *quoted = 0 ;
+   *pos = j ;
+   return 1 ;
+}
+
+
+/* cif_is_null: true for the unquoted '.' (inapplicable) and '?' (unknown) */
+static inline int cif_is_null( const char *tok, int toklen, int quoted )
+{
+   return ((! quoted) && (toklen == 1) && ((tok[0] == '.') || (tok[0] == '?'))) ;
+}
+
+#endif
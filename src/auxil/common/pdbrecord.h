@@ -0,0 +1,453 @@
+/* pdbrecord.h - Fixed-column PDB record parsing shared by the auxil C tools
+
+Description: header-only reader and field decoder for PDB coordinate
+records, used by kdcontacts, subset_extractor, altloc_check and
+inscode_check. A line is handled as a pointer and a length; fields are
+decoded straight out of the line, without copying them into temporary
+strings first. Columns are 0-based offsets (PDB column number - 1).
+
+A pdbreader_t maps an uncompressed regular file into memory and hands out
+lines that point into the mapping. Pipes and gzip compressed files are
+read through zlib into a line buffer instead; pdb_error() tells a
+truncated or corrupt gzip file from one that was read to its end.
+
+Fields behave like the strncpy()/atoi()/atof() code they replace: a string
+field holds only the characters that are on the line, and numbers are read
+from the leading part of the field that looks like a number. A single
+column past the end of a short line reads as a blank, as it would on a
+line padded out to 80 columns.
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PDBRECORD_H
+#define PDBRECORD_H
+
+#include<stdlib.h>
+#include<string.h>
+#include<zlib.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+
+
+#define PDBLINELENGTH 256       // longer lines are cut here, the rest skipped
+#define PDBINPUTBUFSIZE 262144  // zlib buffer for streamed input
+
+// ATOM/HETATM fields: 0-based column and width
+#define PDB_ATOMNO      6, 5
+#define PDB_ATOMNA      12, 4
+#define PDB_ALTLOC      16
+#define PDB_RESNA       17, 3
+#define PDB_CHAINID     21
+#define PDB_RESNO       22, 4
+#define PDB_RESNO_FULL  22, 5   // resno with inscode
+#define PDB_INSCODE     26
+#define PDB_X           30, 8
+#define PDB_Y           38, 8
+#define PDB_Z           46, 8
+#define PDB_OCCUP       54, 6
+
+// MODEL field
+#define PDB_MODELNO     10, 4
+
+
+/* input is either a read-only mapping of the whole file (gz == NULL) or a
+   zlib stream, which also passes uncompressed pipes through */
+struct pdbreader_Struct {
+   gzFile       gz ;
+   const char   *map ;
+   size_t       mapsize ;
+   size_t       pos ;           // next unread byte of the mapping
+   int          fd ;
+   int          ownfd ;         // close fd when done with a mapping
+   char         line[PDBLINELENGTH + 1] ;       // current line of gz input
+} ;
+typedef struct pdbreader_Struct pdbreader_t ;
+
+
+
+/* pdb_readline: reads the next line of fp into line, which holds at least
+   PDBLINELENGTH + 1 chars, without its newline (\n or \r\n); sets *len and
+   returns 0 at the end of the file */
+static inline int pdb_readline( gzFile fp, char *line, int *len )
+{
+   int n ;
+
+   if (gzgets(fp, line, PDBLINELENGTH + 1) == NULL) {
+      return 0 ; }
+
+   n = strlen(line) ;
+   if ((n > 0) && (line[n - 1] == '\n')) {
+      line[--n] = '\0' ;
+      if ((n > 0) && (line[n - 1] == '\r')) {
+         line[--n] = '\0' ; }
+
+   } else if (n == PDBLINELENGTH) {
+      int c ;
+      while (((c = gzgetc(fp)) != -1) && (c != '\n')) {
+         ; }
+   }
+
+   *len = n ;
+   return 1 ;
+}
+
+
+/* pdb_fdopen: sets up reading from an open file descriptor, mapping it if
+   it is an uncompressed regular file; returns NULL on failure */
+static inline pdbreader_t *pdb_fdopen( int fd, int ownfd )
+{
+   pdbreader_t *r ;
+   struct stat st ;
+
+   r = malloc(sizeof(pdbreader_t)) ;
+   if (r == NULL) {
+      return NULL ; }
+
+   r->gz = NULL ;
+   r->map = NULL ;
+   r->mapsize = 0 ;
+   r->pos = 0 ;
+   r->fd = fd ;
+   r->ownfd = ownfd ;
+
+   if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+       ((unsigned long long) st.st_size == (size_t) st.st_size)) {
+      off_t offset = lseek(fd, 0, SEEK_CUR) ;
+      void *map = NULL ;
+
+      if (offset < 0) {
+         offset = 0 ; }
+
+      if (st.st_size > 0) {
+         map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) ; }
+
+      if (st.st_size == 0) {
+         return r ;
+
+      } else if (map != MAP_FAILED) {
+         const unsigned char *magic = (const unsigned char *) map + offset ;
+
+         if ((st.st_size - offset < 2) ||
+             (magic[0] != 0x1f) || (magic[1] != 0x8b)) {
+#ifdef MADV_SEQUENTIAL
+            madvise(map, st.st_size, MADV_SEQUENTIAL) ;
+#endif
+            r->map = map ;
+            r->mapsize = st.st_size ;
+            r->pos = offset ;
+            return r ;
+         }
+
+         munmap(map, st.st_size) ;
+      }
+   }
+
+   r->gz = gzdopen(fd, "rb") ;
+   if (r->gz == NULL) {
+      free(r) ;
+      return NULL ;
+   }
+   gzbuffer(r->gz, PDBINPUTBUFSIZE) ;
+
+   return r ;
+}
+
+
+/* pdb_open: opens a pdb file, plain or gzip compressed; returns NULL if it
+   can not be read */
+static inline pdbreader_t *pdb_open( const char *fn )
+{
+   pdbreader_t *r ;
+   int fd ;
+
+   fd = open(fn, O_RDONLY) ;
+   if (fd < 0) {
+      return NULL ; }
+
+   r = pdb_fdopen(fd, 1) ;
+   if (r == NULL) {
+      close(fd) ; }
+
+   return r ;
+}
+
+
+/* pdb_nextline: points *line at the next line, which is not NUL terminated
+   and has no newline (\n or \r\n), and sets *len; returns 0 at the end of
+   the file */
+static inline int pdb_nextline( pdbreader_t *r, const char **line, int *len )
+{
+   const char *start ;
+   const char *nl ;
+   size_t n ;
+
+   if (r->gz != NULL) {
+      *line = r->line ;
+      return pdb_readline(r->gz, r->line, len) ;
+   }
+
+   if (r->pos >= r->mapsize) {
+      return 0 ; }
+
+   start = r->map + r->pos ;
+   nl = memchr(start, '\n', r->mapsize - r->pos) ;
+   n = (nl != NULL) ? (size_t) (nl - start) : (r->mapsize - r->pos) ;
+   r->pos += n + 1 ;
+   if ((nl != NULL) && (n > 0) && (start[n - 1] == '\r')) {
+      n-- ; }
+
+   *line = start ;
+   *len = (n > PDBLINELENGTH) ? PDBLINELENGTH : (int) n ;
+   return 1 ;
+}
+
+
+/* pdb_error: why reading stopped early, or NULL if the end of the file
+   was reached. pdb_nextline() returns 0 both at the end of a file and on a
+   truncated or corrupt gzip stream, so callers that read to the end should
+   check this before trusting what they read */
+static inline const char *pdb_error( pdbreader_t *r )
+{
+   const char *msg ;
+   int errnum ;
+
+   if (r->gz == NULL) {
+      return NULL ; }
+
+   msg = gzerror(r->gz, &errnum) ;
+   if ((errnum == Z_OK) || (errnum == Z_STREAM_END)) {
+      return NULL ; }
+
+// zlib names the stream after its descriptor, which means nothing to a user
+   if ((strncmp(msg, "<fd:", 4) == 0) && (strstr(msg, ">: ") != NULL)) {
+      msg = strstr(msg, ">: ") + 3 ; }
+
+   return msg ;
+}
+
+
+/* pdb_tell: the offset of the next unread line, counted in uncompressed
+   bytes */
+static inline long long pdb_tell( pdbreader_t *r )
+{
+   if (r->gz != NULL) {
+      return (long long) gztell(r->gz) ; }
+
+   return (long long) r->pos ;
+}
+
+
+/* pdb_seek: moves the next line read to an offset from pdb_tell(); gzip
+   input is decompressed up to it, so seeks there should go forwards.
+   Returns 0 on failure */
+static inline int pdb_seek( pdbreader_t *r, long long offset )
+{
+   if (r->gz != NULL) {
+      return (gzseek(r->gz, (z_off_t) offset, SEEK_SET) == (z_off_t) offset) ; }
+
+   if ((offset < 0) || ((unsigned long long) offset > r->mapsize)) {
+      return 0 ; }
+
+   r->pos = (size_t) offset ;
+   return 1 ;
+}
+
+
+/* pdb_close: unmaps or closes the input and frees the reader */
+static inline void pdb_close( pdbreader_t *r )
+{
+   if (r->gz != NULL) {
+      gzclose(r->gz) ;          // zlib owns the descriptor
+
+   } else {
+      if (r->map != NULL) {
+         munmap((void *) r->map, r->mapsize) ; }
+      if (r->ownfd) {
+         close(r->fd) ; }
+   }
+
+   free(r) ;
+}
+
+
+/* pdb_is_atom: true for ATOM records */
+static inline int pdb_is_atom( const char *line, int len )
+{
+   return ((len >= 4) && (line[0] == 'A') && (line[1] == 'T') &&
+           (line[2] == 'O') && (line[3] == 'M')) ;
+}
+
+
+/* pdb_is_hetatm: true for HETATM records */
+static inline int pdb_is_hetatm( const char *line, int len )
+{
+   return ((len >= 6) && (line[0] == 'H') && (line[1] == 'E') &&
+           (line[2] == 'T') && (line[3] == 'A') && (line[4] == 'T') &&
+           (line[5] == 'M')) ;
+}
+
+
+/* pdb_is_model: true for MODEL records */
+static inline int pdb_is_model( const char *line, int len )
+{
+   return ((len >= 5) && (line[0] == 'M') && (line[1] == 'O') &&
+           (line[2] == 'D') && (line[3] == 'E') && (line[4] == 'L')) ;
+}
+
+
+/* pdb_is_endmdl: true for ENDMDL records */
+static inline int pdb_is_endmdl( const char *line, int len )
+{
+   return ((len >= 6) && (line[0] == 'E') && (line[1] == 'N') &&
+           (line[2] == 'D') && (line[3] == 'M') && (line[4] == 'D') &&
+           (line[5] == 'L')) ;
+}
+
+
+/* pdb_char: the character in column col, ' ' past the end of the line, so
+   that a missing column reads as blank */
+static inline char pdb_char( const char *line, int len, int col )
+{
+   return (col < len) ? line[col] : ' ' ;
+}
+
+
+/* pdb_copy: copies a field into out, which holds width + 1 chars */
+static inline void pdb_copy( const char *line, int len, int col, int width, char *out )
+{
+   int n = len - col ;
+
+   if (n > width) {
+      n = width ; }
+   if (n < 0) {
+      n = 0 ; }
+
+   memcpy(out, (line + col), n) ;
+   out[n] = '\0' ;
+}
+
+
+/* pdb_copy_trimmed: copies a field into out without leading and trailing
+   blanks, runs of blanks inside the field shrunk to one */
+static inline void pdb_copy_trimmed( const char *line, int len, int col, int width, char *out )
+{
+   int end = (col + width < len) ? (col + width) : len ;
+   int n = 0 ;
+   int j ;
+
+   for (j = col; j < end; j++) {
+      if ((line[j] == ' ') && ((n == 0) || (out[n - 1] == ' '))) {
+         continue ; }
+      out[n++] = line[j] ;
+   }
+
+   if ((n > 0) && (out[n - 1] == ' ')) {
+      n-- ; }
+   out[n] = '\0' ;
+}
+
+
+/* pdb_int: decodes an integer field as atoi() would */
+static inline int pdb_int( const char *line, int len, int col, int width )
+{
+   int end = (col + width < len) ? (col + width) : len ;
+   int neg = 0 ;
+   int value = 0 ;
+   int j = col ;
+
+   while ((j < end) && ((line[j] == ' ') || (line[j] == '\t'))) {
+      j++ ; }
+
+   if ((j < end) && ((line[j] == '-') || (line[j] == '+'))) {
+      neg = (line[j] == '-') ;
+      j++ ;
+   }
+
+   for (; (j < end) && (line[j] >= '0') && (line[j] <= '9'); j++) {
+      value = 10 * value + (line[j] - '0') ; }
+
+   return neg ? -value : value ;
+}
+
+
+/* pdb_float: decodes a fixed-point field as atof() would. The digits are
+   collected into an integer and divided once by a power of ten, which
+   rounds exactly as strtod() does; anything else (exponents, very long
+   fields) is left to strtod() */
+static inline float pdb_float( const char *line, int len, int col, int width )
+{
+   static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                  1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15} ;
+   int end = (col + width < len) ? (col + width) : len ;
+   long long mantissa = 0 ;
+   int numdigits = 0 ;
+   int fracdigits = 0 ;
+   int neg = 0 ;
+   int j = col ;
+   double value ;
+
+   while ((j < end) && ((line[j] == ' ') || (line[j] == '\t'))) {
+      j++ ; }
+
+   if ((j < end) && ((line[j] == '-') || (line[j] == '+'))) {
+      neg = (line[j] == '-') ;
+      j++ ;
+   }
+
+   for (; (j < end) && (line[j] >= '0') && (line[j] <= '9'); j++) {
+      mantissa = 10 * mantissa + (line[j] - '0') ;
+      numdigits++ ;
+   }
+
+   if ((j < end) && (line[j] == '.')) {
+      for (j++; (j < end) && (line[j] >= '0') && (line[j] <= '9'); j++) {
+         mantissa = 10 * mantissa + (line[j] - '0') ;
+         numdigits++ ;
+         fracdigits++ ;
+      }
+   }
+
+   if ((numdigits > 15) ||
+       ((j < end) && ((line[j] == 'e') || (line[j] == 'E') ||
+                      (line[j] == 'x') || (line[j] == 'X') ||
+                      (line[j] == 'n') || (line[j] == 'N') ||
+                      (line[j] == 'i') || (line[j] == 'I')))) {
+      char field[64] ;
+
+      pdb_copy(line, len, col, ((width < 63) ? width : 63), field) ;
+      return (float) atof(field) ;
+   }
+
+   if (numdigits == 0) {
+      return 0.0f ; }             // atof("-") is 0, not -0
+
+   value = (double) mantissa / pow10[fracdigits] ;
+
+   return (float) (neg ? -value : value) ;
+}
+
+#endif
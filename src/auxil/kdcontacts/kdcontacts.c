@@ -1,13 +1,114 @@
 /* kdcontacts.c - Calculates interatomic distances of PDB ATOMs
 
 Description: Lists all atom pairs where distance is below a given threshold.
-Uses a three dimensional kd-tree to efficiently perform fixed radius queries
-of PDB coordinates.
-
-Usage: ./kdcontacts [sphere radius] < pdbfile
+Uses a three dimensional kd-tree (or optionally a uniform cell grid) to
+efficiently perform fixed radius queries of PDB coordinates.
+
+Usage: ./kdcontacts [-t threads] [--unique-pairs] [-b | --residue-pairs]
+                    [--specials paramfile] [--subsets assignfile]
+                    [--kernel scalar|sse2|avx2] [--engine kdtree|grid]
+                    [--all-models] [--ligands] [--ligand-names list]
+                    [--no-waters] [--cutoffs list]
+                    [--vdw paramfile] [--vdw-tolerance distance]
+                    [sphere radius] < pdbfile
+       ./kdcontacts [options] --batch manifest
 Sphere radius defaults to 5 Angstroms
 
-NOTE: - only uses ^ATOM records
+Options:
+   -t N   split the queries over N threads; output is identical to (and in
+          the same order as) a single-threaded run
+   --unique-pairs
+          report each contact once, as (i, j) with atom i read before atom
+          j, instead of as both (i, j) and (j, i)
+   -b, --binary
+          write the atom table once followed by packed (atom i, atom j,
+          distance) records instead of text; see kdcontacts_bin.h.
+          kdcontacts_decode turns it back into the text output
+   --residue-pairs
+          instead of atom contacts, report one row per contacting residue
+          pair: number of atom contacts, minimum distance and the number of
+          contacts within 4, 4.5, 5 and 5.5 Angstroms. Hydrogens (H or Q
+          in the second column of the atom name) and contacts within a
+          residue are skipped, as in calc/interfaces.pm. Each pair is
+          listed once, residue 1 being the one whose resno\nchain sorts last
+   --specials paramfile
+          implies --residue-pairs; also counts the hydrogen bonds, salt
+          bridges and disulfide bonds of every residue pair, using the
+          thresholds and atom tables in paramfile (special_contacts.params
+          holds the PIBASE defaults)
+   --subsets assignfile
+          only report contacts across subset (domain) boundaries. The file
+          has one tab-delimited chain_id, resno (with inscode) and
+          subset_id per line, and a residue may be listed under more than
+          one subset. As in calc/interfaces.pm a contact is kept if at
+          least one residue is assigned and the two residues' lists of
+          subsets differ. Residues with the same list of subsets, and the
+          unassigned atoms, get their own kd-tree, and such a group is only
+          searched against trees whose bounding boxes come within the
+          radius of its own
+   --kernel scalar|sse2|avx2
+          leaf scanning kernel; by default the widest one the CPU supports
+          is picked at run time
+   --engine kdtree|grid
+          search structure. grid bins the atoms into cubic cells at least
+          one radius wide and scans the 27 cells around each query atom, or
+          the 13 cells of a half shell when pairs are wanted once. It finds
+          the same contacts as the kd-tree; only the order of the lines of
+          the text and binary output differs
+   --batch manifest
+          process many structures in one run instead of reading STDIN. The
+          manifest ('-' for STDIN) has one whitespace-delimited bdp_id,
+          pdb file and optional radius per line. The output of every entry
+          is framed by "#batch_entry\tbdp_id" and "#batch_end\tbdp_id"
+          lines; an entry that can not be processed gets a
+          "#batch_error\tbdp_id\tmessage" line instead and the batch goes
+          on. Not available with -b or --subsets
+   --all-models
+          read every model of an ensemble (NMR models, MD snapshots)
+          instead of stopping at the first ENDMDL. Every model gets its own
+          trees and is only searched against itself; the threads of -t
+          take whole models. Text output gets a leading model column
+          holding the MODEL serial number. --residue-pairs sums the counts
+          over the ensemble and adds the number of models in which the
+          pair is in contact and that number over the number of models
+          read. Not available with -b
+   --ligands
+          protein-ligand contacts: HETATM records are read as well, only
+          the ATOM atoms are put in the kd-trees and only the HETATM atoms
+          are run against them. Implies --residue-pairs, with residue 1
+          being the ligand instance (chain, resno and inscode of the
+          HETATM residue) and residue 2 a protein residue it contacts, so
+          every row is one binding site residue of one ligand instance.
+          Not available with -b or --subsets
+   --ligand-names list
+          implies --ligands; only reads the HETATM residues named in the
+          comma-separated list (e.g. HEM,NAG)
+   --no-waters
+          implies --ligands; skips HOH, WAT, DOD and H2O HETATM residues
+   --cutoffs list
+          implies --residue-pairs; comma-separated, ascending distances
+          (at most 8) that replace the 4, 4.5, 5 and 5.5 Angstrom counts
+          with a histogram: column shell_d counts the contacts farther
+          than the previous cutoff and at most d apart. The sphere radius
+          is raised to the last cutoff if it is smaller
+   --vdw paramfile
+          per atom type radii: a contact needs a distance of at most the
+          two atoms' van der Waals radii plus a tolerance (vdw_radii.params
+          holds Bondi radii). The element is taken from the first two
+          columns of the atom name. The sphere radius is set to the largest
+          possible radius sum plus the tolerance
+   --vdw-tolerance distance
+          overrides the tolerance of the --vdw parameter file
+
+NOTE: - only uses ^ATOM records of a PDB file
+      - ^HETATM records, and the HETATM rows of an mmCIF file, are only
+        used with --ligands
+      - a file starting with data_ is read as mmCIF from its _atom_site
+        loop. Only the first model is read unless --all-models, and the
+        auth_ items are preferred over the label_ ones
+      - an mmCIF chain id longer than 4 chars is an error, not cut short
+      - the pdb file, on STDIN or in a --batch manifest, may be gzip
+        compressed. An uncompressed file (not a pipe) is memory mapped
 
 
 
@@ -38,29 +139,70 @@ along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
 #include<stdlib.h>
 #include<math.h>
 #include<string.h>
+#include<pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KDCONTACTS_X86 1
+#include<immintrin.h>
+#endif
+
+#include "kdcontacts_bin.h"
+#include "pdbrecord.h"
+#include "cifrecord.h"
 
 
 //#define DEBUG 1
-#define MAXLINELENGTH 80
+
+#define USAGE "usage: kdcontacts [-t threads] [--unique-pairs] [-b | --residue-pairs]\n" \
+   "                  [--specials paramfile] [--subsets assignfile]\n" \
+   "                  [--kernel scalar|sse2|avx2] [--engine kdtree|grid]\n" \
+   "                  [--all-models] [--ligands] [--ligand-names list]\n" \
+   "                  [--no-waters] [--cutoffs list]\n" \
+   "                  [--vdw paramfile] [--vdw-tolerance distance]\n" \
+   "                  [sphere radius] < pdbfile\n" \
+   "       kdcontacts [options] --batch manifest"
 
 #define INITNUMATOMS 100
+#define INITNUMMODELS 16
+#define CHAINIDLENGTH 4         // longest chain id accepted from mmCIF files
+#define CIFVALUELENGTH 32
+#define MAXREADERRORLENGTH 128
 #define ATOMBLOCKSIZE 100
 
-#define INITSETSIZE 100
-#define SETBLOCKSIZE 100
+#define LEAFSIZE 8
+#define PARALLELBUILDSIZE 32768   // smallest subtree handed to its own thread
+#define NINTHERSIZE 1024          // shortest run whose pivot is a ninther
+#define MORTONBITS 10             // bits per dimension of a Morton code
+#define SCANBLOCKSIZE 64
+
+#define ATOMSPERJOB 512
+#define INITOUTBUFSIZE 65536
+#define MAXATOMTEXT 48          // longest fixed text of an atom in a contact line
+#define MAXNUMBERTEXT 64        // longest model number or distance in a contact line
+
+#define INITRESPAIRSLOTS 1024
+#define MAXRESPAIRCUTOFFS 8
+
+#define MAXPARAMLINELENGTH 256
+#define INITNUMSUBSETS 16
+#define INITNUMSPECIALS 64
+#define MAXVDWTYPES 64
 
 
 
 //STRUCTURES
 
+/* chainid holds the multi-character chain ids of mmCIF files; it fits in
+   what used to be padding, so atom_t is no larger than with 1 char ids */
 struct atom_Struct {
    int          atomno ;
    char         atomna[5] ;
    char         altloc[2] ;
    char         resna[4] ;
-   char         chainid[2] ;
+   char         chainid[CHAINIDLENGTH + 1] ;
    signed int   resno ;
    char         inscode[2] ;
+   char         hetatm ;        // read from a HETATM record (--ligands)
 
    float        coord[3] ;
 
@@ -70,801 +212,3094 @@ typedef struct atom_Struct atom_t ;
 
 
 
+/* the atoms of model m are details[modelstart[m], modelstart[m+1]); a file
+   without MODEL records is read as a single model numbered 1 */
 struct readinatoms_Struct {
    int          number ;
+   int          size ;          // allocated length of details
    float        coord_max[3] ;
    float        coord_min[3] ;
    atom_t       *details ;
+   float        *vdwradius ;    // --vdw: radius of every atom, else NULL
+   int          nummodels ;
+   int          modelsize ;     // allocated length of modelnum
+   int          *modelstart ;
+   int          *modelnum ;     // MODEL serial number of every model
+   char         error[MAXREADERRORLENGTH] ; // why the file was not read, "" if it was
 } ;
 typedef struct readinatoms_Struct readinatoms_t ;
 
 
-typedef enum {CHILD_LEFT, CHILD_RIGHT} lorr_t ;
 
+struct residue_Struct {
+   char         resno[13] ;     // resno and inscode, as in calc/interfaces.pm
+   char         chainid[CHAINIDLENGTH + 1] ;    // " " for a blank chain
+   char         resna[4] ;
+   int          rank ;          // position of resno\nchain in string order
+} ;
+typedef struct residue_Struct residue_t ;
 
-struct kdtree_Struct {
-   struct kdtree_Struct *parent;
 
-   int          depth ; // will store point number if leaf
+struct residuesig_Struct {
+   char         sig[13 + CHAINIDLENGTH + 2] ;
+   int          residue ;
+} ;
+typedef struct residuesig_Struct residuesig_t ;
 
-   int          *points ;
-   int          numpoints ;
 
-   float        splitval ;
+struct subsetassign_Struct {
+   int          residue ;
+   int          subset ;        // subset ids are numbered in file order
+} ;
+typedef struct subsetassign_Struct subsetassign_t ;
 
-   float        bound_min[3] ;  // stores bounds from ancestors
-   float        bound_max[3] ;  // stores bounds from ancestors
-   lorr_t       lorr ;  //is this node the LEFT or RIGHT child of the parent
 
-   struct kdtree_Struct *left ;
-   struct kdtree_Struct *right ;
+struct readinresidues_Struct {
+   int          number ;
+   residue_t    *details ;
+   int          *atomres ;      // residue index of every atom
+   unsigned char *atomclass ;   // special contact class of every atom
+   residuesig_t *sigs ;         // residue signatures in rank order
 } ;
-typedef struct kdtree_Struct kdtree_t ;
+typedef struct readinresidues_Struct readinresidues_t ;
+
 
 
 
-struct splitpoints_Struct {
-   int          *Lset ;
-   int          *Rset ;
-   int          Lsize ;
-   int          Rsize ;
-   float        splitval ;
+
+/* atoms are split into groups (subsets) that each get their own kd-tree;
+   every group has the list of groups whose trees its atoms are run
+   against. Without a subset assignment there is a single group. Every
+   model has its own set of groups, groups m * permodel to
+   (m + 1) * permodel - 1, and they are only run against each other. With
+   --ligands a model has a protein (ATOM) group and a ligand (HETATM)
+   group, and only the ligand group is run against the protein one */
+struct subsetgroups_Struct {
+   int          number ;
+   int          permodel ;
+   int          *atomgroup ;    // group of every atom
+   int          *numatoms ;     // atoms in every group
+   float        (*bound_min)[3] ;       // bounding box of every group
+   float        (*bound_max)[3] ;
+   struct kdtree_Struct **trees ;       // ENGINE_KDTREE; NULL for an empty group
+   struct cellgrid_Struct **grids ;     // ENGINE_GRID; NULL for an empty group
+   int          *numtargets ;
+   int          **targets ;
+   int          *queryorder ;   // atoms in the order they are run, NULL for atom order
 } ;
-typedef struct splitpoints_Struct splitpoints_t ;
+typedef struct subsetgroups_Struct subsetgroups_t ;
 
 
-typedef enum { SAME, LESS, MORE } point_point_t ;
-typedef enum { EMPTY, INTERSECT, CONTAINED } range_range_t ;
 
+/* special contacts: the per-atom hydrogen bond and salt bridge flags of
+   special_contacts.params are folded into one small atom class at read time,
+   and pairclass[][] says which special contacts a pair of classes can form,
+   so classifying a contact never touches a string */
+typedef enum { SPECIAL_SSBOND, SPECIAL_SALT, SPECIAL_HBOND, NUMSPECIALS } special_t ;
+typedef enum { THRESH_SSBOND, THRESH_SALT, THRESH_HBOND, THRESH_HBOND_S, NUMSPECIALTHRESH } specialthresh_t ;
 
-//FUNCTION DECLARATION
-#define Error( Str )   fprintf( stderr, "%s\n", Str ), exit( 1 )
+#define FLAG_UNDEF 0            // flag values -1, 0, 1 are stored as 1, 2, 3
+#define NUMATOMCLASSES 48       // 4 hbond flags x 4 salt flags x 3 sulfur types
+#define PAIR_SSBOND 1
+#define PAIR_SALT 2
+#define PAIR_HBOND 4
+#define PAIR_HBOND_S 8
 
-readinatoms_t *readinatoms( void ) ;
+struct specialentry_Struct {
+   special_t    type ;          // SPECIAL_HBOND or SPECIAL_SALT
+   char         resna[4] ;      // "*" for any residue
+   char         atomna[5] ;
+   int          flag ;
+} ;
+typedef struct specialentry_Struct specialentry_t ;
 
-kdtree_t *call_build_kdtree( readinatoms_t *atoms ) ;
 
-kdtree_t *build_kdtree(kdtree_t *parent, int depth, int *points, int numpoints, readinatoms_t *atoms, lorr_t lorr ) ;
+struct specialparams_Struct {
+   long         thresh[NUMSPECIALTHRESH] ;      // in micro-Angstroms
+   int          number ;
+   specialentry_t *entries ;
+   unsigned char pairclass[NUMATOMCLASSES][NUMATOMCLASSES] ;
+} ;
+typedef struct specialparams_Struct specialparams_t ;
 
-splitpoints_t split_points (int *points, int numpoints, int depth, readinatoms_t *atoms) ;
 
-float median_quick_select(float arr[], int n ) ;
 
-void display_contacts (kdtree_t *atoms_kdtree, readinatoms_t *atoms, float *radius) ;
+/* van der Waals radii by element, for --vdw */
+struct vdwparams_Struct {
+   float        tolerance ;
+   float        defaultradius ; // element *
+   float        maxradius ;
+   int          number ;
+   char         element[MAXVDWTYPES][3] ;
+   float        radius[MAXVDWTYPES] ;
+} ;
+typedef struct vdwparams_Struct vdwparams_t ;
 
-void atom_contacts (int centerind, float *radius, kdtree_t *atoms_kdtree, readinatoms_t *atoms) ;
 
-void search_kdtree (kdtree_t *cur_kdtree, float *rect_min, float *rect_max, int centerind, float *center, float *radius, readinatoms_t *atoms) ;
 
-range_range_t query_vs_node( kdtree_t *cur_kdtree, float *rect_min, float *rect_max ) ;
+struct respair_Struct {
+   int          res1 ;          // -1 marks an empty hash slot
+   int          res2 ;
+   int          contacts ;
+   float        min_dist ;
+   int          counts[MAXRESPAIRCUTOFFS] ;
+   int          specials[NUMSPECIALS] ;
+   int          models ;        // --all-models: models with a contact
+   int          lastmodel ;     // model index + 1 of the last contact counted
+} ;
+typedef struct respair_Struct respair_t ;
 
-void report_kdtree( kdtree_t *cur_kdtree, int centerind, float *center, float *radius, readinatoms_t *atoms) ;
 
-float eucliddist( float a[3], float b[3]) ;
+/* open addressing hash of residue pairs, one per thread */
+struct respairtable_Struct {
+   int          number ;
+   int          size ;          // power of two
+   respair_t    *slots ;
+} ;
+typedef struct respairtable_Struct respairtable_t ;
 
 
+typedef enum { OUTPUT_TEXT, OUTPUT_BINARY, OUTPUT_RESPAIRS } outformat_t ;
 
+typedef enum { ENGINE_KDTREE, ENGINE_GRID } engine_t ;
 
-int main(int argc, char *argv[])
-{
-   readinatoms_t *atoms ;
-   kdtree_t *atoms_kdtree ;
-   float radius ;
 
-   if (argc > 1 ) {
-      radius = atof(argv[1]) ;
-   } else {
-      radius = 5.0 ;
-   }
+/* mmCIF _atom_site items that readincifatoms() uses */
+typedef enum { CIF_GROUP, CIF_ID, CIF_TYPE_SYMBOL,
+               CIF_LABEL_ATOM_ID, CIF_AUTH_ATOM_ID, CIF_ALT_ID,
+               CIF_LABEL_COMP_ID, CIF_AUTH_COMP_ID,
+               CIF_LABEL_ASYM_ID, CIF_AUTH_ASYM_ID,
+               CIF_LABEL_SEQ_ID, CIF_AUTH_SEQ_ID, CIF_INS_CODE,
+               CIF_X, CIF_Y, CIF_Z, CIF_OCCUPANCY, CIF_MODEL,
+               NUMCIFITEMS } cifitem_t ;
 
-   atoms = readinatoms() ;
-#ifdef DEBUG
-   fprintf(stderr, "read %d atoms\n", atoms->number) ;
-#endif
+/* one row of the _atom_site loop; only the items above are kept */
+struct cifrow_Struct {
+   char         value[NUMCIFITEMS][CIFVALUELENGTH] ;
+   int          len[NUMCIFITEMS] ;      // -1 for a missing or null item
+} ;
+typedef struct cifrow_Struct cifrow_t ;
+
+
+/* the kd-tree is stored flat: internal nodes are kept in heap order (the
+   children of node n are 2n+1 and 2n+2) and only their split values are
+   stored. Every leaf sits at the same depth and owns a contiguous run of
+   the permuted points[] array, so a subtree is always a [lo, hi) range of
+   points[] and node bounds are recomputed on the way down instead of being
+   stored. The coordinates are copied into x[], y[], z[] in the same order so
+   that leaves can be scanned with SIMD loads. maxpoint[] holds the highest
+   atom index under every node, leaves included, so that --unique-pairs can
+   drop subtrees holding only atoms numbered below the query atom. The
+   struct, the split values, maxpoint[], points[] and the coordinates come
+   from one malloc().*/
+struct kdtree_Struct {
+   int          numpoints ;
+   int          depth ;         // depth of the leaf level; root is depth 0
 
-   atoms_kdtree = call_build_kdtree(atoms) ;
+   float        bound_min[3] ;  // bounds of the root node
+   float        bound_max[3] ;
 
-   display_contacts(atoms_kdtree, atoms, &radius) ;
+   float        *splitval ;     // (2^depth - 1) internal node split values
+   int          *maxpoint ;     // (2^(depth+1) - 1) node maxima, heap order
+   int          *points ;       // atom indices, permuted into leaf runs
+   float        *x ;            // coordinates of points[j]
+   float        *y ;
+   float        *z ;
+} ;
+typedef struct kdtree_Struct kdtree_t ;
 
-   return 0;
-}
 
+/* while a kd-tree is built its points are permuted as packed coordinate
+   plus atom index records, one swap moving a whole record */
+struct buildpoint_Struct {
+   float        coord[3] ;
+   int          point ;
+} ;
+typedef struct buildpoint_Struct buildpoint_t ;
+
+
+/* a subtree build handed to another thread; numtasks is the number of
+   threads the subtree may use in turn */
+struct buildtask_Struct {
+   kdtree_t     *t ;
+   buildpoint_t *work ;
+   int          node ;
+   int          depth ;
+   int          lo ;
+   int          hi ;
+   int          numtasks ;
+} ;
+typedef struct buildtask_Struct buildtask_t ;
 
 
+/* an atom and the Morton (Z-order) code of its position, for sorting the
+   queries so that consecutive ones touch the same tree nodes */
+struct mortonkey_Struct {
+   unsigned int code ;
+   int          atom ;
+} ;
+typedef struct mortonkey_Struct mortonkey_t ;
 
-/* call_build_kdtree: setups atom data for a call to build_kdtree */
-kdtree_t *call_build_kdtree(readinatoms_t *atoms)
-{
-   int *points ;
-   kdtree_t *atoms_kdtree ;
-   kdtree_t *temp_parent = NULL ;
-   int j ;
 
-   points = malloc(atoms->number * sizeof(int)) ;
-   if (points == NULL) {
-      Error("Out of memory on points malloc()\n") ; }
+/* the cell grid covers the bounding box of its atoms with dims[0] x dims[1]
+   x dims[2] cubic cells of side edge >= radius, so every contact of an atom
+   lies in its own or one of the 26 surrounding cells. Cells are numbered x
+   fastest and their atoms are stored contiguously, cell after cell, in
+   points[] and x[], y[], z[]: the cells of one row form a single run.
+   Everything comes from one malloc(), as for the kd-tree */
+struct cellgrid_Struct {
+   int          numpoints ;
+   int          dims[3] ;
+   float        origin[3] ;     // low corner of cell (0, 0, 0)
+   float        edge ;
+   int          *cellstart ;    // cell c holds points[cellstart[c], cellstart[c+1])
+   int          *points ;
+   float        *x ;
+   float        *y ;
+   float        *z ;
+} ;
+typedef struct cellgrid_Struct cellgrid_t ;
+
+
+
+struct kdquery_Struct {
+   int          centerind ;
+   int          mintarget ;     // only atoms numbered >= mintarget are reported
+   int          ordered ;       // report pairs lower atom number first
+   float        *center ;
+   float        radius ;
+   float        radius2 ;       // padded square of radius, for the leaf scan
+   float        inner2 ;        // shrunk square of radius, for unscanned nodes
+   float        rect_min[3] ;
+   float        rect_max[3] ;
+   int          model ;         // model index, -1 unless --all-models
+   outformat_t  outformat ;
+   struct outbuf_Struct *out ;
+   respairtable_t *respairs ;
+   readinresidues_t *residues ;
+   struct specialparams_Struct *specials ;
+   struct kdparams_Struct *params ;
+   const float  *vdwradius ;    // --vdw, else NULL
+   const struct atomtext_Struct *atomtext ;     // text output, else NULL
+} ;
+typedef struct kdquery_Struct kdquery_t ;
 
-   for (j = 0; j < atoms->number; j++ ) {
-      points[j] = j ; }
 
-   atoms_kdtree = build_kdtree(temp_parent, 0, points, atoms->number, atoms, CHILD_LEFT);
 
-   return atoms_kdtree ;
-}
+struct outbuf_Struct {
+   char         *buf ;
+   size_t       len ;
+   size_t       size ;
+} ;
+typedef struct outbuf_Struct outbuf_t ;
 
 
 
-/* build_kdtree: recursively builds a kd-tree */
-kdtree_t *build_kdtree(kdtree_t *parent, int depth, int *points, int numpoints, readinatoms_t *atoms, lorr_t lorr )
-{
-   kdtree_t *t ;
-   int parentdim ;
-   splitpoints_t partition ;
-   int j ;
+/* the text output columns of every atom, "resna\tresno\tinscode\tchain_id\t
+   atomno\tatomna\t", formatted once per structure so that a contact line
+   is put together with two memcpy()s and the distance */
+struct atomtext_Struct {
+   char         *text ;         // atom j is text[start[j], start[j+1])
+   int          *start ;
+} ;
+typedef struct atomtext_Struct atomtext_t ;
+
+
+
+struct kdparams_Struct {
+   float        radius ;
+   int          numthreads ;
+   int          unique_pairs ;
+   outformat_t  outformat ;
+   specialparams_t *specials ;
+   char         *subsets_fn ;
+   engine_t     engine ;
+   int          all_models ;
+   int          ligands ;
+   char         *ligand_names ; // comma-separated HETATM residues to keep
+   int          no_waters ;
+   int          numcutoffs ;    // residue pair distance counts
+   long         cutoffs[MAXRESPAIRCUTOFFS] ;    // in micro-Angstroms
+   int          shells ;        // --cutoffs: count shells, not spheres
+   vdwparams_t  *vdw ;
+} ;
+typedef struct kdparams_Struct kdparams_t ;
 
-   t = malloc(sizeof(kdtree_t)) ;
-   if (t == NULL) {
-      Error("Out of memory on kdtree malloc()\n") ; }
 
 
-   if (parent != NULL) {
-      t->parent = parent ;
-      t->lorr = lorr ;
-   }
+/* a block of consecutive query atoms handled by one thread */
+struct contactjob_Struct {
+   subsetgroups_t *groups ;
+   readinatoms_t *atoms ;
+   kdparams_t   *params ;
+   int          first ;
+   int          last ;
+   int          model ;         // model of the block, -1 unless --all-models
+   outbuf_t     out ;
+   respairtable_t respairs ;
+   readinresidues_t *residues ;
+   atomtext_t   *atomtext ;     // text output, else NULL
+} ;
+typedef struct contactjob_Struct contactjob_t ;
 
 
-   if (numpoints == 1 ) {
+/* leaf scanning kernel: writes the positions j in [lo, hi) whose squared
+   distance to center is at most radius2 into hits[] and returns how many */
+typedef int (*scankernel_t) (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits) ;
 
-      t->numpoints = 1 ;
 
-      t->points = malloc(sizeof(int)) ;
-      if (t->points == NULL) {
-         Error("Error in t->points malloc()\n") ; }
+typedef enum { EMPTY, INTERSECT, CONTAINED } range_range_t ;
 
-      t->points[0] = points[0] ;
 
-      t->left = NULL ;
-      t->right = NULL ;
+//FUNCTION DECLARATION
+#define Error( Str )   fprintf( stderr, "%s\n", Str ), exit( 1 )
 
-      free(points) ;
+scankernel_t scan_points ;      // chosen once in main()
 
-#ifdef DEBUG
-      fprintf(stderr, "%d", t->points[0]) ;
-#endif
+readinatoms_t *readinatoms( pdbreader_t *fp, readinatoms_t *reuse, kdparams_t *params ) ;
 
-   } else {
+int keep_hetatm( kdparams_t *params, const char *resna ) ;
 
-      if (parent != NULL) {
-         t->bound_min[0] = t->parent->bound_min[0];
-         t->bound_min[1] = t->parent->bound_min[1];
-         t->bound_min[2] = t->parent->bound_min[2];
-         t->bound_max[0] = t->parent->bound_max[0];
-         t->bound_max[1] = t->parent->bound_max[1];
-         t->bound_max[2] = t->parent->bound_max[2];
-
-         parentdim = t->parent->depth % 3 ;
-         if (t->lorr == CHILD_LEFT) {
-            t->bound_max[parentdim] = t->parent->splitval ; }
-         if (t->lorr == CHILD_RIGHT) {
-            t->bound_min[parentdim] = t->parent->splitval ; }
-      } else {
-         t->bound_min[0] = atoms->coord_min[0] ;
-         t->bound_min[1] = atoms->coord_min[1] ;
-         t->bound_min[2] = atoms->coord_min[2] ;
+void batch_contacts( char *fn, kdparams_t *params ) ;
 
-         t->bound_max[0] = atoms->coord_max[0] ;
-         t->bound_max[1] = atoms->coord_max[1] ;
-         t->bound_max[2] = atoms->coord_max[2] ;
-      }
+atom_t *new_atom( readinatoms_t *atoms ) ;
 
-      partition = split_points( points, numpoints, depth, atoms ) ;
-      free(points) ;
+void new_model( readinatoms_t *atoms, int modelnum ) ;
 
-      if (partition.Rsize == 0 ) {
-         t->numpoints = partition.Lsize ;
-         t->points = malloc(t->numpoints * sizeof(int)) ;
-         if (t->points == NULL) {
-            Error("Error in t->points malloc()\n") ; }
+void free_atoms( readinatoms_t *atoms ) ;
 
-         for (j = 0; j < t->numpoints; j++) {
-            t->points[j] = partition.Lset[j] ; }
-         
-         t->left = NULL ;
-         t->right = NULL ;
-      } else {
-         t->splitval = partition.splitval ;
-         t->depth = depth ;
+void readincifatoms( pdbreader_t *fp, readinatoms_t *atoms, kdparams_t *params ) ;
 
-#ifdef DEBUG
-         fprintf(stderr, "(") ;
-#endif
+void cifrow_to_atom( cifrow_t *row, atom_t *atom ) ;
 
-         t->left = build_kdtree( t, (depth + 1), partition.Lset, partition.Lsize, atoms, CHILD_LEFT ) ;
+const char *cifrow_item( cifrow_t *row, cifitem_t preferred, cifitem_t fallback, int *len ) ;
 
-#ifdef DEBUG
-         fprintf(stderr, ",") ;
-#endif
+readinresidues_t *readinresidues( readinatoms_t *atoms ) ;
 
-         t->right = build_kdtree( t, (depth + 1), partition.Rset, partition.Rsize, atoms, CHILD_RIGHT ) ;
+void free_residues( readinresidues_t *residues ) ;
 
-#ifdef DEBUG
-         fprintf(stderr, ")") ;
-#endif
-      }
+int residuesig_cmp (const void *a, const void *b) ;
 
-   }
+specialparams_t *readinspecials( char *fn ) ;
 
-   return t ;
-}
+int special_flag_lookup (specialparams_t *specials, special_t type, char *resna, char *atomna) ;
 
+void classify_atoms (readinresidues_t *residues, readinatoms_t *atoms, specialparams_t *specials) ;
 
+void readincutoffs (char *list, kdparams_t *params) ;
 
-/* split_points: splits an array of point numbers on the median value along
-   the dimension corresponding to the current depth */
-splitpoints_t split_points (int *points, int numpoints, int depth, readinatoms_t *atoms)
-{
-   int Dimension = (depth % 3) ;
-   float *curdim ;
+vdwparams_t *readinvdw (char *fn) ;
 
-   int L, R ;
+void assign_vdwradii (readinatoms_t *atoms, vdwparams_t *vdw) ;
 
-   int curLsize = INITSETSIZE ;
-   int curRsize = INITSETSIZE ;
+void set_search_radius (kdparams_t *params) ;
 
-   int j ;
+kdtree_t *call_build_kdtree( readinatoms_t *atoms, int *points, int numpoints, int numthreads ) ;
 
-   splitpoints_t result ;
+cellgrid_t *build_cellgrid( readinatoms_t *atoms, int *points, int numpoints, float *bound_min, float *bound_max, float radius ) ;
 
-   result.Lset = malloc(curLsize * sizeof(int)) ;
-   if (result.Lset == NULL) {
-      Error("Out of memory on Lset malloc()\n") ; }
+subsetgroups_t *build_subsetgroups( readinatoms_t *atoms, readinresidues_t *residues, kdparams_t *params ) ;
 
-   result.Rset = malloc(curRsize * sizeof(int)) ;
-   if (result.Rset == NULL) {
-      Error("Out of memory on Rset malloc()\n") ; }
+int *readinsubsets( char *fn, readinresidues_t *residues, int *numsubsets ) ;
 
+int subsetassign_cmp (const void *a, const void *b) ;
 
-   curdim = malloc(numpoints * sizeof(float)) ;
-   if (curdim == NULL) {
-      Error("Out of memory on curdim malloc()\n") ; }
+void free_subsetgroups( subsetgroups_t *groups ) ;
 
+int *morton_order( readinatoms_t *atoms, readinresidues_t *residues ) ;
 
-   for (j = 0; j < numpoints; j++ ) {
-      curdim[j] = atoms->details[points[j]].coord[Dimension] ; }
+unsigned int morton_spread( unsigned int v ) ;
 
-   result.splitval = median_quick_select(curdim, numpoints) ;
+int mortonkey_cmp (const void *a, const void *b) ;
 
-   free(curdim) ;
+void build_kdtree(kdtree_t *t, buildpoint_t *work, int node, int depth, int lo, int hi, int numtasks ) ;
 
+int set_maxpoint( kdtree_t *t, int node, int depth, int lo, int hi ) ;
 
-   L = 0;
-   R = 0;
+void *build_worker (void *arg) ;
 
-   for (j = 0; j < numpoints; j++ ) {
+float select_pivot (buildpoint_t *work, int lo, int hi, int dim) ;
 
-      if ( atoms->details[points[j]].coord[Dimension] <= result.splitval) {
+float median3 (float a, float b, float c) ;
 
-         if (L >= curLsize) {
-            int *newp;
-            curLsize += SETBLOCKSIZE ;
-            newp = realloc(result.Lset, curLsize * sizeof(atom_t)) ;
-            if (newp == NULL) {
-               Error("Out of Memmory on realloc()\n") ; }
-            result.Lset = newp ;
-         }
+void select_points (buildpoint_t *work, int lo, int hi, int k, int dim) ;
 
-         result.Lset[L] = points[j] ;
-         L++ ;
+contactjob_t *new_contactjobs (kdparams_t *params) ;
 
-      } else {
+void free_contactjobs (contactjob_t *jobs, kdparams_t *params) ;
 
-         if (R >= curRsize) {
-            int *newp;
-            curRsize += SETBLOCKSIZE ;
-            newp = realloc(result.Rset, curRsize * sizeof(atom_t)) ;
-            if (newp == NULL) {
-               Error("Out of Memmory on realloc()\n") ; }
-            result.Rset = newp ;
-         }
+void display_contacts (contactjob_t *jobs, subsetgroups_t *groups, readinatoms_t *atoms, readinresidues_t *residues, kdparams_t *params) ;
 
-         result.Rset[R] = points[j] ;
-         R++ ;
-      }
+void *contact_worker (void *arg) ;
 
-   }
+void atom_contacts (int centerind, kdparams_t *params, subsetgroups_t *groups, readinatoms_t *atoms, contactjob_t *job) ;
 
-   result.Lsize = L ;
-   result.Rsize = R ;
+void search_kdtree (kdtree_t *t, int node, int depth, int lo, int hi, float *bound_min, float *bound_max, kdquery_t *query, readinatoms_t *atoms) ;
 
-   return result ;
-}
+range_range_t query_vs_node( const float *bound_min, const float *bound_max, kdquery_t *query ) ;
 
+void search_cellgrid (cellgrid_t *grid, int halfshell, kdquery_t *query, readinatoms_t *atoms) ;
 
-#define ELEM_SWAP(a,b) { register float t=(a);(a)=(b);(b)=t; }
+void report_points( const int *points, const float *x, const float *y, const float *z, int lo, int hi, kdquery_t *query, readinatoms_t *atoms) ;
 
-/*
-   median_quick_select:
-   returns the median of an array of floats using the Quick Select algorithm 
+int first_point_from( const int *points, int lo, int hi, int mintarget ) ;
 
- ``Fast median search: an ANSI C implementation'', Nicolas Devillard
- http://ndevilla.free.fr/median/median/src/quickselect.c
+void report_node( const int *points, const float *x, const float *y, const float *z, int lo, int hi, kdquery_t *query, readinatoms_t *atoms) ;
 
-*/
-float median_quick_select(float arr[], int n)  
-{
-    int low, high ;
-    int median;
-    int middle, ll, hh;
+void record_contact( kdquery_t *query, readinatoms_t *atoms, int atom1, int atom2, float dist) ;
 
-    low = 0 ; high = n-1 ; median = (low + high) / 2;
-    for (;;) {
-        if (high <= low) /* One element only */
-            return arr[median] ;
+float eucliddist( float a[3], float b[3]) ;
 
-        if (high == low + 1) {  /* Two elements only */
-            if (arr[low] > arr[high])
-                ELEM_SWAP(arr[low], arr[high]) ;
-            return arr[median] ;
-        }
+scankernel_t select_scan_kernel( char *name ) ;
 
-    /* Find median of low, middle and high items; swap into position low */
-    middle = (low + high) / 2;
-    if (arr[middle] > arr[high])    ELEM_SWAP(arr[middle], arr[high]) ;
-    if (arr[low] > arr[high])       ELEM_SWAP(arr[low], arr[high]) ;
-    if (arr[middle] > arr[low])     ELEM_SWAP(arr[middle], arr[low]) ;
+int scan_points_scalar (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits) ;
 
-    /* Swap low item (now in position middle) into position (low+1) */
-    ELEM_SWAP(arr[middle], arr[low+1]) ;
+#ifdef KDCONTACTS_X86
+int scan_points_sse2 (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits) ;
 
-    /* Nibble from each end towards middle, swapping items when stuck */
-    ll = low + 1;
-    hh = high;
-    for (;;) {
-        do ll++; while (arr[low] > arr[ll]) ;
-        do hh--; while (arr[hh]  > arr[low]) ;
+int scan_points_avx2 (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits) ;
+#endif
 
-        if (hh < ll)
-        break;
+void write_binary_header (readinatoms_t *atoms, kdparams_t *params) ;
 
-        ELEM_SWAP(arr[ll], arr[hh]) ;
-    }
+void add_respair_contact (kdquery_t *query, readinatoms_t *atoms, int atom1, int atom2, float dist) ;
 
-    /* Swap middle item (in position low) back into correct position */
-    ELEM_SWAP(arr[low], arr[hh]) ;
+respair_t *respair_lookup (respairtable_t *table, int res1, int res2) ;
 
-    /* Re-set active partition */
-    if (hh <= median)
-        low = ll;
-        if (hh >= median)
-        high = hh - 1;
-    }
+void merge_respairs (respairtable_t *to, respairtable_t *from) ;
 
-}
+void clear_respairs (respairtable_t *table) ;
 
-#undef ELEM_SWAP
+void display_respairs (respairtable_t *table, readinresidues_t *residues, kdparams_t *params, int nummodels) ;
 
+int respair_cmp (const void *a, const void *b) ;
 
-/* display_contacts; for each atom displays a list of other atoms within a given radius */
-void display_contacts (kdtree_t *atoms_kdtree, readinatoms_t *atoms, float *radius)
-{
-   int j ;
+void outbuf_write( outbuf_t *out, const void *data, size_t size ) ;
 
-   printf("#resna1\tresno1\tinscode1\tchain_id1\tatomno1\tatomna1\tresna2\tresno2\tinscode2\tchain_id2\tatomno2\tatomna2\tdistance\n") ;
+char *outbuf_reserve( outbuf_t *out, size_t size ) ;
 
-   for (j = 0; j < atoms->number ; j++) {
+atomtext_t *new_atomtext( readinatoms_t *atoms ) ;
 
-#ifdef DEBUG
-      fprintf(stderr, "\n%s %d %s %d (%d):\n", atoms->details[j].resna,
-         atoms->details[j].resno, atoms->details[j].atomna,
-         atoms->details[j].atomno, j ) ;
-#endif
+void free_atomtext( atomtext_t *atomtext ) ;
 
-      atom_contacts(j, radius, atoms_kdtree, atoms ) ;
-   }
+char *format_int( char *p, int value ) ;
+
+char *format_distance( char *p, float dist ) ;
 
-#ifdef DEBUG
-   fprintf(stderr, "\n") ;
-#endif
-}
 
 
-/* atom_contacts; displays all atoms within a radius of a given atom*/
-void atom_contacts (int centerind, float *radius, kdtree_t *atoms_kdtree, readinatoms_t *atoms)
-{
-   float *center ;
-   float rect_max[3] ;
-   float rect_min[3] ;
 
+int main(int argc, char *argv[])
+{
+   readinatoms_t *atoms ;
+   readinresidues_t *residues = NULL ;
+   subsetgroups_t *groups ;
+   contactjob_t *jobs ;
+   kdparams_t params ;
+   char *batch_fn = NULL ;
+   char *rest ;
+   pdbreader_t *fp ;
    int i ;
 
-   center = atoms->details[centerind].coord ;
+   params.radius = 5.0 ;
+   params.numthreads = 1 ;
+   params.unique_pairs = 0 ;
+   params.outformat = OUTPUT_TEXT ;
+   params.specials = NULL ;
+   params.subsets_fn = NULL ;
+   params.engine = ENGINE_KDTREE ;
+   params.all_models = 0 ;
+   params.ligands = 0 ;
+   params.ligand_names = NULL ;
+   params.no_waters = 0 ;
+   params.shells = 0 ;
+   params.vdw = NULL ;
+   readincutoffs("4,4.5,5,5.5", &params) ;
+
+   scan_points = select_scan_kernel(NULL) ;
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-t") == 0) {
+         if (++i >= argc) {
+            Error(USAGE) ; }
+         params.numthreads = atoi(argv[i]) ;
+         if (params.numthreads < 1) {
+            Error("ERROR: -t needs a positive number of threads") ; }
+      } else if (strcmp(argv[i], "--unique-pairs") == 0) {
+         params.unique_pairs = 1 ;
+      } else if ((strcmp(argv[i], "-b") == 0) ||
+                 (strcmp(argv[i], "--binary") == 0)) {
+         params.outformat = OUTPUT_BINARY ;
+      } else if (strcmp(argv[i], "--residue-pairs") == 0) {
+         params.outformat = OUTPUT_RESPAIRS ;
+      } else if (strcmp(argv[i], "--specials") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --specials needs a parameter file") ; }
+         params.specials = readinspecials(argv[i]) ;
+         params.outformat = OUTPUT_RESPAIRS ;
+      } else if (strcmp(argv[i], "--subsets") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --subsets needs a subset assignment file") ; }
+         params.subsets_fn = argv[i] ;
+      } else if (strcmp(argv[i], "--kernel") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --kernel needs scalar, sse2 or avx2") ; }
+         scan_points = select_scan_kernel(argv[i]) ;
+      } else if (strcmp(argv[i], "--engine") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --engine needs kdtree or grid") ; }
+         if (strcmp(argv[i], "kdtree") == 0) {
+            params.engine = ENGINE_KDTREE ;
+         } else if (strcmp(argv[i], "grid") == 0) {
+            params.engine = ENGINE_GRID ;
+         } else {
+            Error("ERROR: --engine needs kdtree or grid") ; }
+      } else if (strcmp(argv[i], "--all-models") == 0) {
+         params.all_models = 1 ;
+      } else if (strcmp(argv[i], "--ligands") == 0) {
+         params.ligands = 1 ;
+      } else if (strcmp(argv[i], "--ligand-names") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --ligand-names needs a list of residue names") ; }
+         params.ligand_names = argv[i] ;
+         params.ligands = 1 ;
+      } else if (strcmp(argv[i], "--no-waters") == 0) {
+         params.no_waters = 1 ;
+         params.ligands = 1 ;
+      } else if (strcmp(argv[i], "--cutoffs") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --cutoffs needs a list of distances") ; }
+         readincutoffs(argv[i], &params) ;
+         params.shells = 1 ;
+         params.outformat = OUTPUT_RESPAIRS ;
+      } else if (strcmp(argv[i], "--vdw") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --vdw needs a parameter file") ; }
+         params.vdw = readinvdw(argv[i]) ;
+      } else if (strcmp(argv[i], "--vdw-tolerance") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --vdw-tolerance needs a distance") ; }
+         if (params.vdw == NULL) {
+            Error("ERROR: --vdw-tolerance needs --vdw first") ; }
+         params.vdw->tolerance = atof(argv[i]) ;
+      } else if (strcmp(argv[i], "--batch") == 0) {
+         if (++i >= argc) {
+            Error("ERROR: --batch needs a manifest file") ; }
+         batch_fn = argv[i] ;
+      } else if (argv[i][0] == '-') {
+         fprintf(stderr, "ERROR: unknown option %s\n", argv[i]) ;
+         Error(USAGE) ;
+      } else {
+         params.radius = strtod(argv[i], &rest) ;
+         if ((rest == argv[i]) || (*rest != '\0') || (params.radius < 0)) {
+            fprintf(stderr, "ERROR: bad sphere radius %s\n", argv[i]) ;
+            Error(USAGE) ;
+         }
+      }
+   }
+
+   if (params.all_models && (params.outformat == OUTPUT_BINARY)) {
+      Error("ERROR: --all-models can not be combined with -b") ; }
+
+   if (params.ligands) {
+      if (params.subsets_fn != NULL) {
+         Error("ERROR: --ligands can not be combined with --subsets") ; }
+      if (params.outformat == OUTPUT_BINARY) {
+         Error("ERROR: --ligands can not be combined with -b") ; }
+      params.outformat = OUTPUT_RESPAIRS ;
+   }
+
+   set_search_radius(&params) ;
+
+   if (batch_fn != NULL) {
+      if ((params.outformat == OUTPUT_BINARY) || (params.subsets_fn != NULL)) {
+         Error("ERROR: --batch can not be combined with -b or --subsets") ; }
+      batch_contacts(batch_fn, &params) ;
+      return 0 ;
+   }
 
+   fp = pdb_fdopen(fileno(stdin), 0) ;
+   if (fp == NULL) {
+      Error("ERROR: can not read STDIN") ; }
+   atoms = readinatoms(fp, NULL, &params) ;
+   pdb_close(fp) ;
+   if (atoms->error[0] != '\0') {
+      fprintf(stderr, "ERROR: %s\n", atoms->error) ;
+      exit(1) ;
+   }
+   if (params.vdw != NULL) {
+      assign_vdwradii(atoms, params.vdw) ; }
 #ifdef DEBUG
-   fprintf(stderr, "searching for (%f, %f, %f) +/- %f\n", center[0], center[1], center[2], *radius) ;
+   fprintf(stderr, "read %d atoms\n", atoms->number) ;
 #endif
 
-   for (i = 0; i < 3; i++ ) {
-      rect_min[i] = center[i] - *radius ;
-      rect_max[i] = center[i] + *radius ;
+   if ((params.outformat == OUTPUT_RESPAIRS) || (params.subsets_fn != NULL)) {
+      residues = readinresidues(atoms) ;
+      if (params.specials != NULL) {
+         classify_atoms(residues, atoms, params.specials) ; }
    }
-   
-   search_kdtree(atoms_kdtree, rect_min, rect_max, centerind, center, radius, atoms) ;
+
+   groups = build_subsetgroups(atoms, residues, &params) ;
+
+   jobs = new_contactjobs(&params) ;
+   display_contacts(jobs, groups, atoms, residues, &params) ;
+
+   return 0;
 }
 
 
-/* search_kdtree: searches the kdtree with a hypercube query range*/
-void search_kdtree (kdtree_t *cur_kdtree, float *rect_min, float *rect_max, int centerind, float *center, float *radius, readinatoms_t *atoms)
-{
-   range_range_t rangecomp ;
 
-   if ((cur_kdtree->left == NULL) && (cur_kdtree->right == NULL) ) {
-      report_kdtree(cur_kdtree, centerind, center, radius, atoms) ;
-      return ;
+/* batch_contacts: runs every structure of a manifest through the contact
+   search in turn. The atom array, the per-thread output buffers and the
+   residue pair tables are kept from one entry to the next; an entry that
+   can not be read is reported in the output and skipped */
+void batch_contacts (char *fn, kdparams_t *params)
+{
+   FILE *manifest ;
+   pdbreader_t *fp ;
+   char line[MAXPARAMLINELENGTH] ;
+   char *bdp_id, *path, *radius, *rest ;
+   readinatoms_t *atoms = NULL ;
+   readinresidues_t *residues ;
+   subsetgroups_t *groups ;
+   contactjob_t *jobs ;
+   kdparams_t entry ;
+
+   if (strcmp(fn, "-") == 0) {
+      manifest = stdin ;
+   } else {
+      manifest = fopen(fn, "r") ;
+      if (manifest == NULL) {
+         fprintf(stderr, "ERROR: batch manifest %s does not exist\n", fn) ;
+         exit(1) ;
+      }
    }
 
-   rangecomp = query_vs_node( cur_kdtree, rect_min, rect_max) ;
+   jobs = new_contactjobs(params) ;
 
-   if (rangecomp == CONTAINED) {
-      report_kdtree(cur_kdtree, centerind, center, radius, atoms) ;
+   while (fgets(line, sizeof(line), manifest)) {
+      line[strcspn(line, "\r\n")] = '\0' ;
 
-   } else if (rangecomp == INTERSECT) {
+      bdp_id = strtok(line, " \t") ;
+      if ((bdp_id == NULL) || (bdp_id[0] == '#')) {
+         continue ; }
+      path = strtok(NULL, " \t") ;
+      radius = strtok(NULL, " \t") ;
 
-      int d = cur_kdtree->depth % 3 ;
-      
-      if ( cur_kdtree->splitval < rect_min[d]) {
+      entry = *params ;
+      if (radius != NULL) {
+         entry.radius = strtod(radius, &rest) ;
+         if ((*rest != '\0') || (entry.radius < 0)) {
+            printf("#batch_error\t%s\tbad radius %s\n", bdp_id, radius) ;
+            fprintf(stderr, "ERROR: %s: bad radius %s\n", bdp_id, radius) ;
+            continue ;
+         }
+         set_search_radius(&entry) ;
+      }
 
-#ifdef DEBUG
-         for (i = 0; i < cur_kdtree->depth ; i++) {
-            fprintf(stderr, " ") ; }
-         fprintf(stderr, "go right\n") ;
-#endif
+      if (path == NULL) {
+         printf("#batch_error\t%s\tno pdb file given\n", bdp_id) ;
+         fprintf(stderr, "ERROR: %s: no pdb file given\n", bdp_id) ;
+         continue ;
+      }
 
-         search_kdtree(cur_kdtree->right, rect_min, rect_max,
-                       centerind, center, radius, atoms) ;
+      fp = pdb_open(path) ;
+      if (fp == NULL) {
+         printf("#batch_error\t%s\tcan not open %s\n", bdp_id, path) ;
+         fprintf(stderr, "ERROR: %s: can not open %s\n", bdp_id, path) ;
+         continue ;
+      }
 
-      } else if ( cur_kdtree->splitval > rect_max[d]) {
+      atoms = readinatoms(fp, atoms, &entry) ;
+      pdb_close(fp) ;
+      if (atoms->error[0] != '\0') {
+         printf("#batch_error\t%s\t%s\n", bdp_id, atoms->error) ;
+         fprintf(stderr, "ERROR: %s: %s\n", bdp_id, atoms->error) ;
+         continue ;
+      }
+      if (entry.vdw != NULL) {
+         assign_vdwradii(atoms, entry.vdw) ; }
+
+      residues = NULL ;
+      if (entry.outformat == OUTPUT_RESPAIRS) {
+         residues = readinresidues(atoms) ;
+         if (entry.specials != NULL) {
+            classify_atoms(residues, atoms, entry.specials) ; }
+      }
 
-#ifdef DEBUG
-         for (i = 0; i < cur_kdtree->depth ; i++) {
-            fprintf(stderr, " ") ; }
-         fprintf(stderr, "go left\n") ;
-#endif
+      groups = build_subsetgroups(atoms, residues, &entry) ;
 
-         search_kdtree(cur_kdtree->left, rect_min, rect_max,
-                       centerind, center, radius, atoms) ;
+      printf("#batch_entry\t%s\n", bdp_id) ;
+      display_contacts(jobs, groups, atoms, residues, &entry) ;
+      printf("#batch_end\t%s\n", bdp_id) ;
 
-      } else {
+      free_subsetgroups(groups) ;
+      if (residues != NULL) {
+         free_residues(residues) ; }
+   }
 
-#ifdef DEBUG
-         for (i = 0; i < cur_kdtree->depth ; i++) {
-            fprintf(stderr, " ") ; }
-         fprintf(stderr, "go right\n") ;
-#endif
+   if (manifest != stdin) {
+      fclose(manifest) ; }
 
-         search_kdtree(cur_kdtree->right, rect_min, rect_max,
-                       centerind, center, radius, atoms) ;
+   free_contactjobs(jobs, params) ;
+   if (atoms != NULL) {
+      free_atoms(atoms) ; }
+}
 
-#ifdef DEBUG
-         for (i = 0; i < cur_kdtree->depth ; i++) {
-            fprintf(stderr, " ") ; }
-         fprintf(stderr, "go left\n") ;
-#endif
 
-         search_kdtree(cur_kdtree->left, rect_min, rect_max,
-                          centerind, center, radius, atoms) ;
 
+
+/* call_build_kdtree: sizes the tree over the given atoms so that no leaf
+   holds more than LEAFSIZE points, carves the tree out of a single
+   allocation and builds it on a packed copy of the points, using up to
+   numthreads threads */
+kdtree_t *call_build_kdtree(readinatoms_t *atoms, int *points, int numpoints, int numthreads)
+{
+   kdtree_t *t ;
+   buildpoint_t *work ;
+   int depth ;
+   int numinternal ;
+   int j ;
+
+   depth = 0 ;
+   while ((((long) numpoints + (1L << depth) - 1) >> depth) > LEAFSIZE) {
+      depth++ ; }
+   numinternal = (1 << depth) - 1 ;
+
+   t = malloc(sizeof(kdtree_t) + numinternal * sizeof(float) +
+              (2 * numinternal + 1) * sizeof(int) +
+              numpoints * (sizeof(int) + 3 * sizeof(float))) ;
+   if (t == NULL) {
+      Error("Out of memory on kdtree malloc()\n") ; }
+
+   t->numpoints = numpoints ;
+   t->depth = depth ;
+   t->splitval = (float *) (t + 1) ;
+   t->maxpoint = (int *) (t->splitval + numinternal) ;
+   t->points = t->maxpoint + 2 * numinternal + 1 ;
+   t->x = (float *) (t->points + numpoints) ;
+   t->y = t->x + numpoints ;
+   t->z = t->y + numpoints ;
+
+   for (j = 0; j < 3; j++ ) {
+      t->bound_min[j] = atoms->coord_min[j] ;
+      t->bound_max[j] = atoms->coord_max[j] ;
+   }
+
+   work = malloc((numpoints > 0 ? numpoints : 1) * sizeof(buildpoint_t)) ;
+   if (work == NULL) {
+      Error("Out of memory on kdtree build malloc()\n") ; }
+
+   for (j = 0; j < numpoints; j++ ) {
+      float *coord = atoms->details[points[j]].coord ;
+      int d ;
+
+      work[j].point = points[j] ;
+      for (d = 0; d < 3; d++) {
+         work[j].coord[d] = coord[d] ;
+         if ((j == 0) || (coord[d] < t->bound_min[d])) {
+            t->bound_min[d] = coord[d] ; }
+         if ((j == 0) || (coord[d] > t->bound_max[d])) {
+            t->bound_max[d] = coord[d] ; }
       }
+   }
 
+   build_kdtree(t, work, 0, 0, 0, numpoints, numthreads) ;
+
+   for (j = 0; j < numpoints; j++ ) {
+      t->points[j] = work[j].point ;
+      t->x[j] = work[j].coord[0] ;
+      t->y[j] = work[j].coord[1] ;
+      t->z[j] = work[j].coord[2] ;
    }
+   free(work) ;
+
+   set_maxpoint(t, 0, 0, 0, numpoints) ;
 
 #ifdef DEBUG
-   else if (rangecomp == EMPTY) {
-      for (i = 0; i < cur_kdtree->depth ; i++) {
-         fprintf(stderr " ") ; }
-      fprintf(stderr, "X\n") ;
-   }
+   fprintf(stderr, "built kd-tree: depth %d, %d internal nodes\n", depth, numinternal) ;
 #endif
 
-   return ;
+   return t ;
 }
 
 
-/* report_kdtree: traverses a kd-tree and displays all terminal nodes */
-void report_kdtree( kdtree_t *cur_kdtree, int queryind, float *center, float *radius, readinatoms_t *atoms)
+/* set_maxpoint: fills in maxpoint[] for the subtree of node, which covers
+   points[lo, hi), splitting ranges as search_kdtree() does; returns the
+   subtree maximum, -1 if it is empty */
+int set_maxpoint( kdtree_t *t, int node, int depth, int lo, int hi )
 {
-   int j ;
-
-   if ((cur_kdtree->left == NULL) && (cur_kdtree->right == NULL) ) {
-      for (j = 0; j < cur_kdtree->numpoints; j++) {
-         int targetind= cur_kdtree->points[j] ;
-         float dist = eucliddist(atoms->details[targetind].coord, center ) ;
-
-         if ((dist <= *radius) && (queryind != targetind)) {
-	    printf("%s\t%d\t%s\t%s\t%d\t%s\t%s\t%d\t%s\t%s\t%d\t%s\t%f\n",
-                   atoms->details[queryind].resna,
-		   atoms->details[queryind].resno,
-		   atoms->details[queryind].inscode,
-		   atoms->details[queryind].chainid,
-		   atoms->details[queryind].atomno,
-		   atoms->details[queryind].atomna,
-
-                   atoms->details[targetind].resna,
-		   atoms->details[targetind].resno,
-		   atoms->details[targetind].inscode,
-		   atoms->details[targetind].chainid,
-		   atoms->details[targetind].atomno,
-		   atoms->details[targetind].atomna,
-
-                   dist ) ;
-         }
+   int max = -1 ;
+   int mid, j ;
 
+   if (depth == t->depth) {
+      for (j = lo; j < hi; j++) {
+         if (t->points[j] > max) {
+            max = t->points[j] ; }
       }
+
    } else {
-      report_kdtree( cur_kdtree->left, queryind, center, radius, atoms ) ;
-      report_kdtree( cur_kdtree->right, queryind, center, radius, atoms ) ;
+      mid = lo + (hi - lo) / 2 ;
+      max = set_maxpoint(t, (2 * node + 1), (depth + 1), lo, mid) ;
+      j = set_maxpoint(t, (2 * node + 2), (depth + 1), mid, hi) ;
+      if (j > max) {
+         max = j ; }
    }
 
-   return ;
+   t->maxpoint[node] = max ;
+   return max ;
 }
 
 
-/* query_vs_node: determines the overlap between the query and the ndoe hypercubes ranges*/
-range_range_t query_vs_node( kdtree_t *cur_kdtree, float *rect_min, float *rect_max )
-{
-   range_range_t overlap[3] ;
-   range_range_t result ;
-
-   point_point_t qmin_bmin ;
-   point_point_t qmin_bmax ;
-   point_point_t qmax_bmin ;
-   point_point_t qmax_bmax ;
-
-   int i ;
-
 
-#ifdef DEBUG
-   fprintf(stderr, "*** Node:\t%f - %f\t%f - %f\t%f - %f\n", cur_kdtree->bound_min[0], cur_kdtree->bound_max[0], cur_kdtree->bound_min[1], cur_kdtree->bound_max[1], cur_kdtree->bound_min[2], cur_kdtree->bound_max[2]) ;
+/* build_subsetgroups: splits the atoms into groups by subset assignment,
+   builds a kd-tree (or cell grid) per group and decides which groups' trees
+   the atoms of every group are run against */
+subsetgroups_t *build_subsetgroups (readinatoms_t *atoms, readinresidues_t *residues, kdparams_t *params)
+{
+   subsetgroups_t *result ;
+   int *points ;
+   int *groupstart ;
+   int *groupsize ;
+   int *ressubset = NULL ;
+   int once ;
+   int g, h, i, d, m ;
 
-   fprintf(stderr, "  - Query:\t%f - %f\t%f - %f\t%f - %f\n", rect_min[0], rect_max[0], rect_min[1], rect_max[1], rect_min[2], rect_max[2]) ;
-#endif
+   result = malloc(sizeof(subsetgroups_t)) ;
+   if (result == NULL) {
+      Error("Out of memory on groups malloc()\n") ; }
 
+   result->atomgroup = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(int)) ;
+   points = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(int)) ;
+   if ((result->atomgroup == NULL) || (points == NULL)) {
+      Error("Out of memory on groups malloc()\n") ; }
 
-   for (i = 0; i < 3; i++) {
+   result->permodel = 1 ;
+   if (params->ligands) {
+      result->permodel = 2 ;
 
-      if (rect_min[i] < cur_kdtree->bound_min[i]) {
-         qmin_bmin = LESS;
-      } else if (rect_min[i] > cur_kdtree->bound_min[i]) {
-         qmin_bmin = MORE;
-      } else if (rect_min[i] == cur_kdtree->bound_min[i]) {
-         qmin_bmin = SAME;
-      }
+   } else if (params->subsets_fn != NULL) {
+      int numsubsets ;
 
+// the last group of a model holds the atoms of unassigned residues
+      ressubset = readinsubsets(params->subsets_fn, residues, &numsubsets) ;
+      result->permodel = numsubsets + 1 ;
+   }
 
-      if (rect_min[i] < cur_kdtree->bound_max[i]) {
-         qmin_bmax = LESS;
-      } else if (rect_min[i] > cur_kdtree->bound_max[i]) {
-         qmin_bmax = MORE;
-      } else if (rect_min[i] == cur_kdtree->bound_max[i]) {
-         qmin_bmax = SAME;
+   result->number = atoms->nummodels * result->permodel ;
+   for (m = 0; m < atoms->nummodels; m++) {
+      for (i = atoms->modelstart[m]; i < atoms->modelstart[m + 1]; i++) {
+         g = m * result->permodel ;
+         if (params->ligands) {
+            g += atoms->details[i].hetatm ;
+         } else if (ressubset != NULL) {
+            int subset = ressubset[residues->atomres[i]] ;
+            g += (subset >= 0) ? subset : (result->permodel - 1) ;
+         }
+         result->atomgroup[i] = g ;
       }
-
-      if (rect_max[i] < cur_kdtree->bound_min[i]) {
-         qmax_bmin = LESS;
-      } else if (rect_max[i] > cur_kdtree->bound_min[i]) {
-         qmax_bmin = MORE;
-      } else if (rect_max[i] == cur_kdtree->bound_min[i]) {
-         qmax_bmin = SAME;
+   }
+   free(ressubset) ;
+
+   result->trees = malloc(result->number * sizeof(kdtree_t *)) ;
+   result->grids = malloc(result->number * sizeof(cellgrid_t *)) ;
+   result->numtargets = malloc(result->number * sizeof(int)) ;
+   result->targets = malloc(result->number * sizeof(int *)) ;
+   result->bound_min = malloc(result->number * sizeof(*result->bound_min)) ;
+   result->bound_max = malloc(result->number * sizeof(*result->bound_max)) ;
+   groupstart = calloc(result->number + 1, sizeof(int)) ;
+   groupsize = calloc(result->number, sizeof(int)) ;
+   if ((result->trees == NULL) || (result->grids == NULL) ||
+       (result->numtargets == NULL) || (result->targets == NULL) ||
+       (result->bound_min == NULL) || (result->bound_max == NULL) ||
+       (groupstart == NULL) || (groupsize == NULL)) {
+      Error("Out of memory on groups malloc()\n") ; }
+
+   for (i = 0; i < atoms->number; i++) {
+      groupstart[result->atomgroup[i] + 1]++ ; }
+   for (g = 0; g < result->number; g++) {
+      groupstart[g + 1] += groupstart[g] ; }
+   for (i = 0; i < atoms->number; i++) {
+      float *coord = atoms->details[i].coord ;
+
+      g = result->atomgroup[i] ;
+      for (d = 0; d < 3; d++) {
+         if ((groupsize[g] == 0) || (coord[d] < result->bound_min[g][d])) {
+            result->bound_min[g][d] = coord[d] ; }
+         if ((groupsize[g] == 0) || (coord[d] > result->bound_max[g][d])) {
+            result->bound_max[g][d] = coord[d] ; }
       }
-
-      if (rect_max[i] < cur_kdtree->bound_max[i]) {
-         qmax_bmax = LESS;
-      } else if (rect_max[i] > cur_kdtree->bound_max[i]) {
-         qmax_bmax = MORE;
-      } else if (rect_max[i] == cur_kdtree->bound_max[i]) {
-         qmax_bmax = SAME;
+      points[groupstart[g] + groupsize[g]++] = i ;
+   }
+   result->numatoms = groupsize ;
+
+   for (g = 0; g < result->number; g++) {
+      result->trees[g] = NULL ;
+      result->grids[g] = NULL ;
+      if ((groupsize[g] == 0) ||
+          (params->ligands && (g % result->permodel == 1))) {
+         continue ; }
+
+      if (params->engine == ENGINE_GRID) {
+         result->grids[g] = build_cellgrid(atoms, (points + groupstart[g]), groupsize[g],
+                                           result->bound_min[g], result->bound_max[g],
+                                           params->radius) ;
+      } else {
+         result->trees[g] = call_build_kdtree(atoms, (points + groupstart[g]), groupsize[g],
+                                              params->numthreads) ;
       }
+   }
 
-      overlap[i] = EMPTY ;
-
-      if ( ((qmin_bmin == LESS) || (qmin_bmin == SAME)) &&
-           ((qmax_bmax == MORE) || (qmax_bmax == SAME))  ) {
-         overlap[i] = CONTAINED ;
-
-      } else if ( (((qmin_bmin == SAME) || (qmin_bmin == MORE)) &&
-                   (qmax_bmax == LESS)) ||
-                  (((qmax_bmax == SAME) || (qmax_bmax == LESS)) &&
-                   (qmin_bmin == MORE)) ) {
-         overlap[i] = INTERSECT ;
+   once = (params->unique_pairs || (params->outformat == OUTPUT_RESPAIRS)) ;
 
-      } else if ( ( ((qmin_bmin == LESS) && (qmax_bmax == LESS)) &&
-                    ((qmax_bmin == SAME) || (qmax_bmin == MORE))) ||
+   for (g = 0; g < result->number; g++) {
+      result->numtargets[g] = 0 ;
+      result->targets[g] = malloc(result->permodel * sizeof(int)) ;
+      if (result->targets[g] == NULL) {
+         Error("Out of memory on groups malloc()\n") ; }
 
-                  ( ((qmin_bmin == MORE) && (qmax_bmax == MORE)) &&
-                    ((qmin_bmax == SAME) || (qmin_bmax == LESS)) ) ) {
+      if (result->numatoms[g] == 0) {
+         continue ; }
 
-         overlap[i] = INTERSECT ;
+      if (params->ligands) {
+         if ((g % result->permodel == 1) && (result->numatoms[g - 1] > 0)) {
+            result->targets[g][result->numtargets[g]++] = g - 1 ; }
+         continue ;
       }
 
-
-#ifdef DEBUG
-      switch (overlap[i]) {
-         case EMPTY: fprintf(stderr, "%d is empty\n", i) ; break;
-         case INTERSECT: fprintf(stderr, "%d is intersect\n", i) ; break;
-         case CONTAINED: fprintf(stderr, "%d is contained\n", i) ; break;
+      if (params->subsets_fn == NULL) {
+         result->targets[g][result->numtargets[g]++] = g ;
+         continue ;
       }
-#endif
-
-   }
 
-   result = overlap[0] ;
+      m = g / result->permodel ;
+      for (h = m * result->permodel; h < (m + 1) * result->permodel; h++) {
+         int overlap = 1 ;
 
-   if (result != EMPTY) {
-      for (i = 1; i < 3; i++) {
+         if ((h == g) || (result->numatoms[h] == 0) || (once && (h < g))) {
+            continue ; }
 
-         if (overlap[i] == EMPTY) {
-            result = EMPTY ;
-            break;
-         } else if (overlap[i] == INTERSECT) {
-            result = INTERSECT;
+         for (d = 0; d < 3; d++) {
+            if ((result->bound_min[g][d] - params->radius > result->bound_max[h][d]) ||
+                (result->bound_min[h][d] - params->radius > result->bound_max[g][d])) {
+               overlap = 0 ; }
          }
 
+         if (overlap) {
+            result->targets[g][result->numtargets[g]++] = h ; }
       }
-   }
 
 #ifdef DEBUG
-   if (result == EMPTY) {
-      fprintf(stderr, "   EMTPY\n") ;
-   } else if (result == INTERSECT) {
-      fprintf(stderr, "   INTERSECT\n") ;
-   } else if (result == CONTAINED) {
-      fprintf(stderr, "   CONTAINED\n") ;
-   }
+      fprintf(stderr, "group %d: %d atoms, searched against %d groups\n", g, groupsize[g], result->numtargets[g]) ;
 #endif
+   }
+
+// the residue pair tables do not depend on the order the atoms are run in
+   result->queryorder = NULL ;
+   if (params->outformat == OUTPUT_RESPAIRS) {
+      result->queryorder = morton_order(atoms, residues) ; }
+
+   free(points) ;
+   free(groupstart) ;
 
    return result ;
 }
 
 
-
-/* readinatoms: reads in ATOM records from STDIN and returns a pointer to a
-   readinatoms)_t struct with a pointer to an array of atom_t structs,
-   the number of atoms, and the coordinate minimum and maximum along each
-   dimension*/
-readinatoms_t *readinatoms (void)
+/* morton_order: returns the atoms of every model sorted by the Morton code
+   of their position in the bounding box of the structure, so that atoms
+   run one after the other are near each other; models keep their place.
+   Every atom takes the code of the first atom of its residue, so the atoms
+   of a residue stay together and keep hitting the same residue pairs */
+int *morton_order (readinatoms_t *atoms, readinresidues_t *residues)
 {
-   char line[MAXLINELENGTH] ;
-   char tempsubstr[MAXLINELENGTH] ;
+   mortonkey_t *keys ;
+   int *order ;
+   float scale[3] ;
+   int d, j, m ;
 
-   int i, j;
-   readinatoms_t *result ;
-   int atomlistsize = INITNUMATOMS ;
+   keys = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(mortonkey_t)) ;
+   order = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(int)) ;
+   if ((keys == NULL) || (order == NULL)) {
+      Error("Out of memory on query order malloc()\n") ; }
 
+   for (d = 0; d < 3; d++) {
+      float extent = atoms->coord_max[d] - atoms->coord_min[d] ;
 
-   result = malloc(sizeof(readinatoms_t)) ;
-   if (result == NULL) {
-      Error("Out of memory on result malloc()\n") ;
+      scale[d] = (extent > 0.0) ? (((1 << MORTONBITS) - 1) / extent) : 0.0 ;
    }
 
-   result->details = malloc(atomlistsize * sizeof(atom_t)) ;
-   if (result->details == NULL) {
-      Error("Out of memory on details malloc()\n") ;
-   }
+   for (j = 0; j < atoms->number; j++) {
+      float *coord = atoms->details[j].coord ;
 
+      keys[j].atom = j ;
+      if ((j > 0) && (residues != NULL) &&
+          (residues->atomres[j] == residues->atomres[j - 1])) {
+         keys[j].code = keys[j - 1].code ;
+         continue ;
+      }
 
-   i = 0;
-   j = 1;
-   while ((fgets(line, sizeof(line), stdin)) && j ) {
+      keys[j].code = 0 ;
+      for (d = 0; d < 3; d++) {
+         unsigned int cell = (unsigned int) ((coord[d] - atoms->coord_min[d]) * scale[d]) ;
 
-      *(line+(strlen(line)-1)) = '\0';
+         if (cell >= (1 << MORTONBITS)) {
+            cell = (1 << MORTONBITS) - 1 ; }
+         keys[j].code |= morton_spread(cell) << d ;
+      }
+   }
 
-      if ((line[0] == 'A') &&
-          (line[1] == 'T') &&
-          (line[2] == 'O') &&
-          (line[3] == 'M')) {
+   for (m = 0; m < atoms->nummodels; m++) {
+      qsort((keys + atoms->modelstart[m]),
+            (atoms->modelstart[m + 1] - atoms->modelstart[m]),
+            sizeof(mortonkey_t), mortonkey_cmp) ;
+   }
 
-         if( i >= atomlistsize) {
-            atom_t *newp;
-            atomlistsize += ATOMBLOCKSIZE ;
-            newp = realloc(result->details, atomlistsize * sizeof(atom_t)) ;
+   for (j = 0; j < atoms->number; j++) {
+      order[j] = keys[j].atom ; }
 
-            if (newp == NULL) {
-               Error("Out of Memmory on realloc()\n") ;
-            }
+   free(keys) ;
+   return order ;
+}
 
-            result->details = newp ;
-         }
 
-         strncpy(tempsubstr, (line + 6), 5) ;
-         *(tempsubstr+(5)) = '\0';
-         result->details[i].atomno = atoi( tempsubstr ) ;
-      
-         strncpy( result->details[i].atomna, (line + 12), 4 ) ;
-         result->details[i].atomna[4] = '\0' ;
-      
-         strncpy(result->details[i].altloc, (line + 16), 1) ;
-         result->details[i].altloc[1] = '\0' ;
-      
-         strncpy(result->details[i].resna, (line + 17), 3) ;
-         result->details[i].resna[3] = '\0' ;
-      
-         strncpy(result->details[i].chainid, (line + 21), 1) ;
-         result->details[i].chainid[1] = '\0' ;
-      
-         strncpy(tempsubstr, (line + 22), 4) ;
-         *(tempsubstr+(4)) = '\0' ;
-         result->details[i].resno = atoi( tempsubstr ) ;
-      
-         strncpy(result->details[i].inscode, (line + 26), 1) ;
-         result->details[i].inscode[1] = '\0' ;
-      
-         strncpy(tempsubstr, (line+30), 8) ;
-         *(tempsubstr+(8)) = '\0';
-         result->details[i].coord[0] = atof( tempsubstr ) ;
-      
-         strncpy(tempsubstr, (line+38), 8) ;
-         *(tempsubstr+(8)) = '\0';
-         result->details[i].coord[1] = atof( tempsubstr ) ;
-      
-         strncpy(tempsubstr, (line+46), 8) ;
-         *(tempsubstr+(8)) = '\0';
-         result->details[i].coord[2] = atof( tempsubstr ) ;
-      
-         strncpy(tempsubstr, (line+54), 6) ;
-         *(tempsubstr+(6)) = '\0';
-         result->details[i].occup = atof( tempsubstr ) ;
-
-
-         if (i == 0 ) {
-            result->coord_min[0] = result->details[i].coord[0] ;
-            result->coord_min[1] = result->details[i].coord[1] ;
-            result->coord_min[2] = result->details[i].coord[2] ;
-            result->coord_max[0] = result->details[i].coord[0] ;
-            result->coord_max[1] = result->details[i].coord[1] ;
-            result->coord_max[2] = result->details[i].coord[2] ;
+/* morton_spread: spreads the low MORTONBITS bits of v out to every third
+   bit, so that three spread values interleave into a Morton code */
+unsigned int morton_spread (unsigned int v)
+{
+   v &= (1 << MORTONBITS) - 1 ;
+   v = (v | (v << 16)) & 0x030000FF ;
+   v = (v | (v << 8)) & 0x0300F00F ;
+   v = (v | (v << 4)) & 0x030C30C3 ;
+   v = (v | (v << 2)) & 0x09249249 ;
 
-         } else {
+   return v ;
+}
 
-            if (result->coord_min[0] > result->details[i].coord[0]) {
-               result->coord_min[0] = result->details[i].coord[0] ; }
-            if (result->coord_min[1] > result->details[i].coord[1]) {
-               result->coord_min[1] = result->details[i].coord[1] ; }
-            if (result->coord_min[2] > result->details[i].coord[2]) {
-               result->coord_min[2] = result->details[i].coord[2] ; }
-
-            if (result->coord_max[0] < result->details[i].coord[0]) {
-               result->coord_max[0] = result->details[i].coord[0] ; }
-            if (result->coord_max[1] < result->details[i].coord[1]) {
-               result->coord_max[1] = result->details[i].coord[1] ; }
-            if (result->coord_max[2] < result->details[i].coord[2]) {
-               result->coord_max[2] = result->details[i].coord[2] ; }
-         }
 
+/* mortonkey_cmp: qsort() comparison of Morton keys, by code and then atom */
+int mortonkey_cmp (const void *a, const void *b)
+{
+   const mortonkey_t *ka = a ;
+   const mortonkey_t *kb = b ;
 
-         i++ ;
+   if (ka->code != kb->code) {
+      return (ka->code < kb->code) ? -1 : 1 ; }
 
-      } else if ( (line[0] == 'E') &&
-                (line[1] == 'N') &&
-                (line[2] == 'D') &&
-                (line[3] == 'M') &&
-                (line[4] == 'D') &&
-                (line[5] == 'L') ) {
+   return ka->atom - kb->atom ;
+}
 
-         j = 0;
 
-      }
+/* free_subsetgroups: frees the groups and their trees or grids */
+void free_subsetgroups (subsetgroups_t *groups)
+{
+   int g ;
 
+   for (g = 0; g < groups->number; g++) {
+      free(groups->trees[g]) ;
+      free(groups->grids[g]) ;
+      free(groups->targets[g]) ;
    }
 
-   result->number = i ;
-
-   return result ;
+   free(groups->trees) ;
+   free(groups->grids) ;
+   free(groups->targets) ;
+   free(groups->numtargets) ;
+   free(groups->numatoms) ;
+   free(groups->bound_min) ;
+   free(groups->bound_max) ;
+   free(groups->atomgroup) ;
+   free(groups->queryorder) ;
+   free(groups) ;
 }
 
 
-/* eucliddist: determines the euclidean distance between two 3D points */
-float eucliddist (float a[3], float b[3])
+/* build_cellgrid: sizes the grid over the given atoms, carves it out of a
+   single allocation and sorts the atoms into their cells. The cell edge is
+   the radius, padded so that rounding can never put a contact two cells
+   away, and widened if needed so a sparse structure does not get many more
+   cells than atoms */
+cellgrid_t *build_cellgrid(readinatoms_t *atoms, int *points, int numpoints, float *bound_min, float *bound_max, float radius)
 {
-   float distance ;
+   cellgrid_t *grid ;
+   int *cellof ;
+   long numcells ;
+   float edge ;
+   int c, d, j ;
+
+   edge = radius * 1.001 + 0.001 ;
+   for (;;) {
+      numcells = 1 ;
+      for (d = 0; d < 3; d++) {
+         numcells *= (long) ((bound_max[d] - bound_min[d]) / edge) + 1 ; }
+      if (numcells <= 4L * numpoints + 64) {
+         break ; }
+      edge *= 1.25 ;
+   }
+
+   grid = malloc(sizeof(cellgrid_t) + (numcells + 1) * sizeof(int) +
+                 numpoints * (sizeof(int) + 3 * sizeof(float))) ;
+   cellof = malloc(numpoints * sizeof(int)) ;
+   if ((grid == NULL) || (cellof == NULL)) {
+      Error("Out of memory on cell grid malloc()\n") ; }
+
+   grid->numpoints = numpoints ;
+   grid->edge = edge ;
+   for (d = 0; d < 3; d++) {
+      grid->origin[d] = bound_min[d] ;
+      grid->dims[d] = (int) ((bound_max[d] - bound_min[d]) / edge) + 1 ;
+   }
+   grid->cellstart = (int *) (grid + 1) ;
+   grid->points = grid->cellstart + numcells + 1 ;
+   grid->x = (float *) (grid->points + numpoints) ;
+   grid->y = grid->x + numpoints ;
+   grid->z = grid->y + numpoints ;
+
+// counting sort into cells; atoms stay in input order within a cell
+   for (c = 0; c <= numcells; c++) {
+      grid->cellstart[c] = 0 ; }
+
+   for (j = 0; j < numpoints; j++) {
+      int cell[3] ;
+
+      for (d = 0; d < 3; d++) {
+         cell[d] = (int) ((atoms->details[points[j]].coord[d] - grid->origin[d]) / edge) ;
+         if (cell[d] >= grid->dims[d]) {
+            cell[d] = grid->dims[d] - 1 ; }
+      }
+      cellof[j] = (cell[2] * grid->dims[1] + cell[1]) * grid->dims[0] + cell[0] ;
+      grid->cellstart[cellof[j] + 1]++ ;
+   }
+
+   for (c = 0; c < numcells; c++) {
+      grid->cellstart[c + 1] += grid->cellstart[c] ; }
+
+   for (j = 0; j < numpoints; j++) {
+      int k = grid->cellstart[cellof[j]]++ ;
+      float *coord = atoms->details[points[j]].coord ;
+
+      grid->points[k] = points[j] ;
+      grid->x[k] = coord[0] ;
+      grid->y[k] = coord[1] ;
+      grid->z[k] = coord[2] ;
+   }
+
+// the fill loop advanced every start to the next cell's start
+   for (c = numcells; c > 0; c--) {
+      grid->cellstart[c] = grid->cellstart[c - 1] ; }
+   grid->cellstart[0] = 0 ;
+
+   free(cellof) ;
+
+#ifdef DEBUG
+   fprintf(stderr, "built cell grid: %d x %d x %d cells of %f\n", grid->dims[0], grid->dims[1], grid->dims[2], edge) ;
+#endif
+
+   return grid ;
+}
+
+
+/* readinsubsets: reads a tab-delimited residue to subset assignment
+   (chain_id, resno with inscode, subset_id). A residue may be listed under
+   several subsets; as in calc/interfaces.pm residues are told apart by the
+   sorted list of their subsets, repeats included, so every distinct list
+   becomes one group. Returns the group of every residue, -1 if it is not
+   assigned, and sets *numsubsets to the number of groups */
+int *readinsubsets (char *fn, readinresidues_t *residues, int *numsubsets)
+{
+   FILE *fp ;
+   char line[MAXPARAMLINELENGTH] ;
+   char *chainid, *resno, *subset_id ;
+   char **subset_ids ;
+   int numids = 0 ;
+   int listsize = INITNUMSUBSETS ;
+   subsetassign_t *assign ;
+   int numassign = 0 ;
+   int assignsize = INITNUMSUBSETS ;
+   int *groupstart, *grouplen ;
+   int *result ;
+   int a, b, g, j, k ;
+
+   fp = fopen(fn, "r") ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: subset assignment file %s does not exist\n", fn) ;
+      exit(1) ;
+   }
+
+   result = malloc((residues->number > 0 ? residues->number : 1) * sizeof(int)) ;
+   subset_ids = malloc(listsize * sizeof(char *)) ;
+   assign = malloc(assignsize * sizeof(subsetassign_t)) ;
+   if ((result == NULL) || (subset_ids == NULL) || (assign == NULL)) {
+      Error("Out of memory on subsets malloc()\n") ; }
+
+   for (j = 0; j < residues->number; j++) {
+      result[j] = -1 ; }
+
+   while (fgets(line, sizeof(line), fp)) {
+      residuesig_t key ;
+      residuesig_t *found ;
+
+      line[strcspn(line, "\r\n")] = '\0' ;
+      if ((line[0] == '#') || (line[0] == '\0')) {
+         continue ; }
+
+      chainid = line ;
+      resno = strchr(chainid, '\t') ;
+      subset_id = (resno != NULL) ? strchr(resno + 1, '\t') : NULL ;
+      if (subset_id == NULL) {
+         fprintf(stderr, "ERROR: can not parse line in %s: %s\n", fn, line) ;
+         exit(1) ;
+      }
+      *(resno++) = '\0' ;
+      *(subset_id++) = '\0' ;
+
+// blanks are dropped from the resno, as calc/interfaces.pm does
+      for (j = 0, k = 0; resno[j] != '\0'; j++) {
+         if (resno[j] != ' ') {
+            resno[k++] = resno[j] ; }
+      }
+      resno[k] = '\0' ;
+
+      snprintf(key.sig, sizeof(key.sig), "%s\n%.*s", resno, CHAINIDLENGTH,
+               (chainid[0] != '\0') ? chainid : " ") ;
+      found = bsearch(&key, residues->sigs, residues->number,
+                      sizeof(residuesig_t), residuesig_cmp) ;
+      if (found == NULL) {
+         continue ; }
+
+      for (j = 0; j < numids; j++) {
+         if (strcmp(subset_ids[j], subset_id) == 0) {
+            break ; }
+      }
+
+      if (j == numids) {
+         if (numids >= listsize) {
+            char **newp ;
+            listsize += INITNUMSUBSETS ;
+            newp = realloc(subset_ids, listsize * sizeof(char *)) ;
+            if (newp == NULL) {
+               Error("Out of Memmory on realloc()\n") ; }
+            subset_ids = newp ;
+         }
+         subset_ids[j] = strdup(subset_id) ;
+         if (subset_ids[j] == NULL) {
+            Error("Out of memory on strdup()\n") ; }
+         numids++ ;
+      }
+
+      if (numassign >= assignsize) {
+         subsetassign_t *newp ;
+         assignsize *= 2 ;
+         newp = realloc(assign, assignsize * sizeof(subsetassign_t)) ;
+         if (newp == NULL) {
+            Error("Out of Memmory on realloc()\n") ; }
+         assign = newp ;
+      }
+      assign[numassign].residue = found->residue ;
+      assign[numassign].subset = j ;
+      numassign++ ;
+   }
+
+   fclose(fp) ;
+
+   for (j = 0; j < numids; j++) {
+      free(subset_ids[j]) ; }
+   free(subset_ids) ;
+
+// the assignments of a residue, a run once sorted, are compared with the
+// first residue of every group found so far
+   qsort(assign, numassign, sizeof(subsetassign_t), subsetassign_cmp) ;
+
+   groupstart = malloc((numassign > 0 ? numassign : 1) * sizeof(int)) ;
+   grouplen = malloc((numassign > 0 ? numassign : 1) * sizeof(int)) ;
+   if ((groupstart == NULL) || (grouplen == NULL)) {
+      Error("Out of memory on subsets malloc()\n") ; }
+
+   *numsubsets = 0 ;
+   for (a = 0; a < numassign; a = b) {
+      for (b = a + 1; (b < numassign) && (assign[b].residue == assign[a].residue); b++) {
+         ; }
+
+      for (g = 0; g < *numsubsets; g++) {
+         if (grouplen[g] != b - a) {
+            continue ; }
+         for (k = 0; (k < b - a) &&
+                     (assign[groupstart[g] + k].subset == assign[a + k].subset); k++) {
+            ; }
+         if (k == b - a) {
+            break ; }
+      }
+
+      if (g == *numsubsets) {
+         groupstart[g] = a ;
+         grouplen[g] = b - a ;
+         (*numsubsets)++ ;
+      }
+      result[assign[a].residue] = g ;
+   }
+
+   free(groupstart) ;
+   free(grouplen) ;
+   free(assign) ;
+
+   return result ;
+}
+
+
+/* subsetassign_cmp: qsort() comparison of subset assignments, by residue
+   and then subset */
+int subsetassign_cmp (const void *a, const void *b)
+{
+   const subsetassign_t *x = a ;
+   const subsetassign_t *y = b ;
+
+   if (x->residue != y->residue) {
+      return (x->residue < y->residue) ? -1 : 1 ; }
+   if (x->subset != y->subset) {
+      return (x->subset < y->subset) ? -1 : 1 ; }
+   return 0 ;
+}
+
+
+/* build_kdtree: recursively splits work[lo, hi) at its median along the
+   dimension corresponding to the current depth. The split is by position,
+   so runs of equal coordinates are shared out between both halves. Halves
+   of at least PARALLELBUILDSIZE points are built by two threads while
+   numtasks allows it */
+void build_kdtree(kdtree_t *t, buildpoint_t *work, int node, int depth, int lo, int hi, int numtasks )
+{
+   int dim ;
+   int mid ;
+
+   if (depth == t->depth) {
+      return ; }
+
+   dim = depth % 3 ;
+   mid = lo + (hi - lo) / 2 ;
+
+   select_points(work, lo, hi, mid, dim) ;
+   t->splitval[node] = work[mid].coord[dim] ;
+
+   if ((numtasks > 1) && (mid - lo >= PARALLELBUILDSIZE)) {
+      pthread_t thread ;
+      buildtask_t task ;
+
+      task.t = t ;
+      task.work = work ;
+      task.node = 2 * node + 1 ;
+      task.depth = depth + 1 ;
+      task.lo = lo ;
+      task.hi = mid ;
+      task.numtasks = numtasks / 2 ;
+
+      if (pthread_create(&thread, NULL, build_worker, &task) == 0) {
+         build_kdtree(t, work, (2 * node + 2), (depth + 1), mid, hi, (numtasks - numtasks / 2)) ;
+         pthread_join(thread, NULL) ;
+         return ;
+      }
+   }
+
+   build_kdtree(t, work, (2 * node + 1), (depth + 1), lo, mid, numtasks) ;
+   build_kdtree(t, work, (2 * node + 2), (depth + 1), mid, hi, numtasks) ;
+}
+
+
+void *build_worker (void *arg)
+{
+   buildtask_t *task = arg ;
+
+   build_kdtree(task->t, task->work, task->node, task->depth, task->lo, task->hi, task->numtasks) ;
+
+   return NULL ;
+}
+
+
+#define POINT_KEY(j) (work[(j)].coord[dim])
+
+/* median3: the median of three values */
+float median3 (float a, float b, float c)
+{
+   if (a > b) {
+      float t = a ; a = b ; b = t ; }
+
+   return (c < a) ? a : ((c > b) ? b : c) ;
+}
+
+
+/* select_pivot: the median of the first, middle and last keys of
+   work[lo, hi) or, for long runs, Tukey's ninther (the median of the
+   medians of three evenly spaced triples) */
+float select_pivot (buildpoint_t *work, int lo, int hi, int dim)
+{
+   int n = hi - lo ;
+   int s ;
+
+   if (n < NINTHERSIZE) {
+      return median3(POINT_KEY(lo), POINT_KEY(lo + n / 2), POINT_KEY(hi - 1)) ; }
+
+   s = n / 8 ;
+   return median3(median3(POINT_KEY(lo), POINT_KEY(lo + s), POINT_KEY(lo + 2 * s)),
+                  median3(POINT_KEY(lo + 3 * s), POINT_KEY(lo + 4 * s), POINT_KEY(lo + 5 * s)),
+                  median3(POINT_KEY(lo + 6 * s), POINT_KEY(lo + 7 * s), POINT_KEY(hi - 1))) ;
+}
+
+
+/*
+   select_points:
+   reorders work[lo, hi) so that work[k] holds the point with the
+   (k - lo)-th smallest coordinate along dim, everything before it is <=
+   and everything after it is >=. Quick select around the pivot of
+   select_pivot(), with a three-way split done as two branch free Lomuto passes: the first
+   moves the points below the pivot to the front; if k is not among them a
+   second pass gathers the points equal to the pivot, so inputs with many
+   repeated coordinates do not degrade it and the search stops as soon as
+   k falls on the pivot value.
+*/
+void select_points (buildpoint_t *work, int lo, int hi, int k, int dim)
+{
+   buildpoint_t tmp ;
+   float pivot ;
+   int lt, j ;
+
+   while (hi - lo > 1) {
+
+      pivot = select_pivot(work, lo, hi, dim) ;
+
+   /* [lo, lt) < pivot */
+      lt = lo ;
+      for (j = lo; j < hi; j++) {
+         tmp = work[j] ;
+         work[j] = work[lt] ;
+         work[lt] = tmp ;
+         lt += (tmp.coord[dim] < pivot) ;
+      }
+
+      if (k < lt) {
+         hi = lt ;
+         continue ;
+      }
+
+   /* [lo, lt) == pivot */
+      lo = lt ;
+      for (j = lo; j < hi; j++) {
+         tmp = work[j] ;
+         work[j] = work[lt] ;
+         work[lt] = tmp ;
+         lt += (tmp.coord[dim] <= pivot) ;
+      }
+
+      if (k < lt) {
+         return ; }
+      lo = lt ;
+   }
+}
+
+#undef POINT_KEY
+
+
+/* display_contacts; for each atom displays a list of other atoms within a
+   given radius. Query atoms are handed out in rounds of ATOMSPERJOB-sized
+   blocks (whole models with --all-models), one block per thread; each
+   thread formats into its own buffer and the buffers are written out in
+   atom order once the round is done. In residue pair mode each thread
+   fills its own residue pair table instead, and the tables are merged and
+   displayed at the end */
+void display_contacts (contactjob_t *jobs, subsetgroups_t *groups, readinatoms_t *atoms, readinresidues_t *residues, kdparams_t *params)
+{
+   pthread_t *threads ;
+   atomtext_t *atomtext = NULL ;
+   int numthreads = params->numthreads ;
+   int start ;
+   int model = 0 ;
+   int j ;
+
+   threads = malloc(numthreads * sizeof(pthread_t)) ;
+   if (threads == NULL) {
+      Error("Out of memory on jobs malloc()\n") ; }
+
+   if (params->outformat == OUTPUT_TEXT) {
+      atomtext = new_atomtext(atoms) ; }
+
+   for (j = 0; j < numthreads; j++) {
+      jobs[j].groups = groups ;
+      jobs[j].atoms = atoms ;
+      jobs[j].params = params ;
+      jobs[j].out.len = 0 ;
+      jobs[j].residues = residues ;
+      jobs[j].atomtext = atomtext ;
+      clear_respairs(&jobs[j].respairs) ;
+   }
+
+   if (params->outformat == OUTPUT_BINARY) {
+      write_binary_header(atoms, params) ;
+   } else if (params->outformat == OUTPUT_TEXT) {
+      printf("%sresna1\tresno1\tinscode1\tchain_id1\tatomno1\tatomna1\tresna2\tresno2\tinscode2\tchain_id2\tatomno2\tatomna2\tdistance\n",
+             (params->all_models ? "#model\t" : "#")) ;
+   }
+
+   for (start = 0; start < atoms->number; start = jobs[numthreads - 1].last) {
+
+      for (j = 0; j < numthreads; j++) {
+         jobs[j].first = (j == 0) ? start : jobs[j - 1].last ;
+         jobs[j].model = -1 ;
+
+// a model is never split, so each residue pair of a model is only met by
+//  one thread and its model count stays exact
+         if (params->all_models && (model < atoms->nummodels)) {
+            jobs[j].model = model ;
+            jobs[j].last = atoms->modelstart[++model] ;
+            continue ;
+         }
+
+         jobs[j].last = jobs[j].first + ATOMSPERJOB ;
+         if (params->all_models || (jobs[j].last > atoms->number)) {
+            jobs[j].last = atoms->number ; }
+      }
+
+      for (j = 1; j < numthreads; j++) {
+         if (pthread_create(&threads[j], NULL, contact_worker, &jobs[j]) != 0) {
+            Error("ERROR: pthread_create() failed\n") ; }
+      }
+      contact_worker(&jobs[0]) ;
+
+      for (j = 1; j < numthreads; j++) {
+         pthread_join(threads[j], NULL) ; }
+
+      for (j = 0; j < numthreads; j++) {
+         fwrite(jobs[j].out.buf, 1, jobs[j].out.len, stdout) ;
+         jobs[j].out.len = 0 ;
+      }
+   }
+
+#ifdef DEBUG
+   fprintf(stderr, "\n") ;
+#endif
+
+   if (params->outformat == OUTPUT_RESPAIRS) {
+      for (j = 1; j < numthreads; j++) {
+         merge_respairs(&jobs[0].respairs, &jobs[j].respairs) ; }
+      display_respairs(&jobs[0].respairs, residues, params,
+                       (params->all_models ? atoms->nummodels : 0)) ;
+   }
+
+   if (atomtext != NULL) {
+      free_atomtext(atomtext) ; }
+   free(threads) ;
+}
+
+
+/* new_contactjobs: sets up one job, with its output buffer and residue pair
+   table, per thread; the jobs can be used for any number of structures */
+contactjob_t *new_contactjobs (kdparams_t *params)
+{
+   contactjob_t *jobs ;
+   int j ;
+
+   jobs = malloc(params->numthreads * sizeof(contactjob_t)) ;
+   if (jobs == NULL) {
+      Error("Out of memory on jobs malloc()\n") ; }
+
+   for (j = 0; j < params->numthreads; j++) {
+      jobs[j].out.len = 0 ;
+      jobs[j].out.size = INITOUTBUFSIZE ;
+      jobs[j].out.buf = malloc(jobs[j].out.size) ;
+      if (jobs[j].out.buf == NULL) {
+         Error("Out of memory on output buffer malloc()\n") ; }
+
+      jobs[j].respairs.number = 0 ;
+      jobs[j].respairs.size = 0 ;
+      jobs[j].respairs.slots = NULL ;
+   }
+
+   return jobs ;
+}
+
+
+/* free_contactjobs: frees the jobs and their buffers */
+void free_contactjobs (contactjob_t *jobs, kdparams_t *params)
+{
+   int j ;
+
+   for (j = 0; j < params->numthreads; j++) {
+      free(jobs[j].respairs.slots) ;
+      free(jobs[j].out.buf) ; }
+   free(jobs) ;
+}
+
+
+/* contact_worker: runs the queries for one block of atoms, positions
+   [first, last) of the query order */
+void *contact_worker (void *arg)
+{
+   contactjob_t *job = arg ;
+   int *order = job->groups->queryorder ;
+   int i, j ;
+
+   for (i = job->first; i < job->last ; i++) {
+      j = (order != NULL) ? order[i] : i ;
+
+#ifdef DEBUG
+      fprintf(stderr, "\n%s %d %s %d (%d):\n", job->atoms->details[j].resna,
+         job->atoms->details[j].resno, job->atoms->details[j].atomna,
+         job->atoms->details[j].atomno, j ) ;
+#endif
+
+      atom_contacts(j, job->params, job->groups, job->atoms, job ) ;
+   }
+
+   return NULL ;
+}
+
+
+/* atom_contacts; displays all atoms within a radius of a given atom, searching
+   the trees of every group the atom's own group is run against */
+void atom_contacts (int centerind, kdparams_t *params, subsetgroups_t *groups, readinatoms_t *atoms, contactjob_t *job)
+{
+   kdquery_t query ;
+   float bound_min[3] ;
+   float bound_max[3] ;
+   int group = groups->atomgroup[centerind] ;
+   int once ;
+   int i, k ;
+
+   once = (params->unique_pairs || (params->outformat == OUTPUT_RESPAIRS)) ;
+
+   query.centerind = centerind ;
+   query.ordered = once ;
+   query.center = atoms->details[centerind].coord ;
+   query.radius = params->radius ;
+   query.radius2 = (float) ((double) params->radius * params->radius * 1.0001) ;
+   query.inner2 = (float) ((double) params->radius * params->radius * 0.9999) ;
+   query.model = job->model ;
+   query.outformat = params->outformat ;
+   query.out = &job->out ;
+   query.respairs = &job->respairs ;
+   query.residues = job->residues ;
+   query.specials = params->specials ;
+   query.params = params ;
+   query.vdwradius = atoms->vdwradius ;
+   query.atomtext = job->atomtext ;
+
+#ifdef DEBUG
+   fprintf(stderr, "searching for (%f, %f, %f) +/- %f\n", query.center[0], query.center[1], query.center[2], params->radius) ;
+#endif
+
+   for (i = 0; i < 3; i++ ) {
+      query.rect_min[i] = query.center[i] - params->radius ;
+      query.rect_max[i] = query.center[i] + params->radius ;
+   }
+
+   for (k = 0; k < groups->numtargets[group]; k++) {
+      int target = groups->targets[group][k] ;
+      kdtree_t *t = groups->trees[target] ;
+
+// within a group each pair is met twice; across groups only one of the two
+//  groups is run against the other when pairs are wanted once
+      query.mintarget = 0 ;
+      if (once && (target == group)) {
+         query.mintarget = centerind + 1 ; }
+
+      if (params->engine == ENGINE_GRID) {
+         search_cellgrid(groups->grids[target], (once && (target == group)),
+                         &query, atoms) ;
+         continue ;
+      }
+
+      for (i = 0; i < 3; i++ ) {
+         bound_min[i] = t->bound_min[i] ;
+         bound_max[i] = t->bound_max[i] ;
+      }
+
+      search_kdtree(t, 0, 0, 0, t->numpoints,
+                    bound_min, bound_max, &query, atoms) ;
+   }
+}
+
+
+/* search_kdtree: searches the kdtree with the query sphere; the node
+   covers points[lo, hi) and its bounds are narrowed by the caller. An
+   internal node the sphere misses is dropped and one that lies inside it
+   is reported without testing its points */
+void search_kdtree (kdtree_t *t, int node, int depth, int lo, int hi, float *bound_min, float *bound_max, kdquery_t *query, readinatoms_t *atoms)
+{
+   range_range_t rangecomp ;
+   float child_bound[3] ;
+   int d, mid ;
+
+// with --unique-pairs a subtree of atoms numbered below the query atom has
+// nothing to report
+   if (t->maxpoint[node] < query->mintarget) {
+      return ; }
+
+// a leaf is scanned as is: testing its box would cost about as much
+   if (depth == t->depth) {
+      report_points(t->points, t->x, t->y, t->z, lo, hi, query, atoms) ;
+      return ;
+   }
+
+   rangecomp = query_vs_node( bound_min, bound_max, query) ;
+
+   if (rangecomp == CONTAINED) {
+      report_node(t->points, t->x, t->y, t->z, lo, hi, query, atoms) ;
+
+   } else if (rangecomp == INTERSECT) {
+
+      d = depth % 3 ;
+      mid = lo + (hi - lo) / 2 ;
+
+      if ( t->splitval[node] >= query->rect_min[d]) {
+
+#ifdef DEBUG
+         fprintf(stderr, "%*sgo left\n", depth, "") ;
+#endif
+
+         child_bound[0] = bound_max[0] ;
+         child_bound[1] = bound_max[1] ;
+         child_bound[2] = bound_max[2] ;
+         child_bound[d] = t->splitval[node] ;
+
+         search_kdtree(t, (2 * node + 1), (depth + 1), lo, mid,
+                       bound_min, child_bound, query, atoms) ;
+      }
+
+      if ( t->splitval[node] <= query->rect_max[d]) {
+
+#ifdef DEBUG
+         fprintf(stderr, "%*sgo right\n", depth, "") ;
+#endif
+
+         child_bound[0] = bound_min[0] ;
+         child_bound[1] = bound_min[1] ;
+         child_bound[2] = bound_min[2] ;
+         child_bound[d] = t->splitval[node] ;
+
+         search_kdtree(t, (2 * node + 2), (depth + 1), mid, hi,
+                       child_bound, bound_max, query, atoms) ;
+      }
+
+   }
+
+#ifdef DEBUG
+   else if (rangecomp == EMPTY) {
+      fprintf(stderr, "%*sX\n", depth, "") ;
+   }
+#endif
+
+   return ;
+}
+
+
+/* search_cellgrid: searches the cells of the grid that the query cube
+   touches, at most 3 x 3 x 3 of them. When the query atom belongs to the
+   grid and pairs are wanted once (halfshell), only its own cell and the 13
+   cells that follow it in (z, y, x) order are searched: every pair of
+   neighbouring cells is then met from one side only */
+void search_cellgrid (cellgrid_t *grid, int halfshell, kdquery_t *query, readinatoms_t *atoms)
+{
+   int cell_lo[3], cell_hi[3] ;
+   int mintarget = query->mintarget ;
+   int ix, iy, iz ;
+   int d ;
+
+   for (d = 0; d < 3; d++) {
+      float lo = (query->rect_min[d] - grid->origin[d]) / grid->edge ;
+      float hi = (query->rect_max[d] - grid->origin[d]) / grid->edge ;
+
+      if ((hi < 0) || (lo >= grid->dims[d])) {
+         return ; }
+      cell_lo[d] = (lo > 0) ? (int) lo : 0 ;
+      cell_hi[d] = (hi < grid->dims[d] - 1) ? (int) hi : (grid->dims[d] - 1) ;
+   }
+
+   if (halfshell) {
+      int cell[3] ;
+
+      for (d = 0; d < 3; d++) {
+         cell[d] = (int) ((query->center[d] - grid->origin[d]) / grid->edge) ;
+         if (cell[d] >= grid->dims[d]) {
+            cell[d] = grid->dims[d] - 1 ; }
+      }
+
+// the own cell still needs mintarget; its atoms are in input order, so the
+// ones numbered below it are cut off before the scan. The following cells
+// are met once
+      ix = (cell[2] * grid->dims[1] + cell[1]) * grid->dims[0] + cell[0] ;
+      report_points(grid->points, grid->x, grid->y, grid->z,
+                    first_point_from(grid->points, grid->cellstart[ix],
+                                     grid->cellstart[ix + 1], mintarget),
+                    grid->cellstart[ix + 1], query, atoms) ;
+      query->mintarget = 0 ;
+
+      if (cell[0] < cell_hi[0]) {
+         report_points(grid->points, grid->x, grid->y, grid->z,
+                       grid->cellstart[ix + 1], grid->cellstart[ix + 2], query, atoms) ; }
+
+      cell_lo[2] = cell[2] ;
+      for (iz = cell_lo[2]; iz <= cell_hi[2]; iz++) {
+         for (iy = ((iz == cell[2]) ? (cell[1] + 1) : cell_lo[1]); iy <= cell_hi[1]; iy++) {
+            int row = (iz * grid->dims[1] + iy) * grid->dims[0] ;
+
+            report_points(grid->points, grid->x, grid->y, grid->z,
+                          grid->cellstart[row + cell_lo[0]],
+                          grid->cellstart[row + cell_hi[0] + 1], query, atoms) ;
+         }
+      }
+
+      query->mintarget = mintarget ;
+      return ;
+   }
+
+   for (iz = cell_lo[2]; iz <= cell_hi[2]; iz++) {
+      for (iy = cell_lo[1]; iy <= cell_hi[1]; iy++) {
+         int row = (iz * grid->dims[1] + iy) * grid->dims[0] ;
+
+         report_points(grid->points, grid->x, grid->y, grid->z,
+                       grid->cellstart[row + cell_lo[0]],
+                       grid->cellstart[row + cell_hi[0] + 1], query, atoms) ;
+      }
+   }
+
+   return ;
+}
+
+
+/* first_point_from: the first j in [lo, hi) with points[j] >= mintarget,
+   or hi; points[lo, hi) must be in increasing order */
+int first_point_from( const int *points, int lo, int hi, int mintarget )
+{
+   while (lo < hi) {
+      int mid = lo + (hi - lo) / 2 ;
+
+      if (points[mid] < mintarget) {
+         lo = mid + 1 ;
+      } else {
+         hi = mid ;
+      }
+   }
+
+   return lo ;
+}
+
+
+/* report_points: displays all points[j], j in [lo, hi), that lie within
+   the query radius; x[], y[] and z[] hold their coordinates. The scan
+   kernel compares squared distances against a slightly padded radius2;
+   only its hits get the exact eucliddist() test, so the result is the same
+   as testing every point */
+void report_points( const int *points, const float *x, const float *y, const float *z, int lo, int hi, kdquery_t *query, readinatoms_t *atoms)
+{
+   int hits[SCANBLOCKSIZE] ;
+   int numhits ;
+   int queryind = query->centerind ;
+   int start, end ;
+   int k ;
+
+   for (start = lo; start < hi; start += SCANBLOCKSIZE) {
+      end = (start + SCANBLOCKSIZE < hi) ? (start + SCANBLOCKSIZE) : hi ;
+      numhits = scan_points(x, y, z, start, end, query->center, query->radius2, hits) ;
+
+      for (k = 0; k < numhits; k++) {
+         int targetind = points[hits[k]] ;
+         float target[3] ;
+         float dist ;
+
+         if ((targetind < query->mintarget) || (queryind == targetind)) {
+            continue ; }
+
+         target[0] = x[hits[k]] ;
+         target[1] = y[hits[k]] ;
+         target[2] = z[hits[k]] ;
+         dist = eucliddist(target, query->center ) ;
+
+         if (dist > query->radius) {
+            continue ; }
+
+         if (query->ordered && (targetind < queryind)) {
+            record_contact(query, atoms, targetind, queryind, dist) ;
+         } else {
+            record_contact(query, atoms, queryind, targetind, dist) ;
+         }
+      }
+   }
+
+   return ;
+}
+
+
+/* report_node: displays all points[j], j in [lo, hi), of a node that lies
+   inside the query sphere; only their distances are computed */
+void report_node( const int *points, const float *x, const float *y, const float *z, int lo, int hi, kdquery_t *query, readinatoms_t *atoms)
+{
+   int queryind = query->centerind ;
+   int j ;
+
+   for (j = lo; j < hi; j++) {
+      int targetind = points[j] ;
+      float target[3] ;
+      float dist ;
+
+      if ((targetind < query->mintarget) || (queryind == targetind)) {
+         continue ; }
+
+      target[0] = x[j] ;
+      target[1] = y[j] ;
+      target[2] = z[j] ;
+      dist = eucliddist(target, query->center ) ;
+
+      if (query->ordered && (targetind < queryind)) {
+         record_contact(query, atoms, targetind, queryind, dist) ;
+      } else {
+         record_contact(query, atoms, queryind, targetind, dist) ;
+      }
+   }
+
+   return ;
+}
+
+
+/* record_contact: adds a contact to the output of the current thread */
+void record_contact( kdquery_t *query, readinatoms_t *atoms, int atom1, int atom2, float dist)
+{
+   if ((query->vdwradius != NULL) &&
+       (dist > query->vdwradius[atom1] + query->vdwradius[atom2] +
+               query->params->vdw->tolerance)) {
+      return ; }
+
+   if (query->outformat == OUTPUT_RESPAIRS) {
+      add_respair_contact(query, atoms, atom1, atom2, dist) ;
+
+   } else if (query->outformat == OUTPUT_BINARY) {
+      kdcbin_contact_t contact ;
+
+      contact.atom1 = atom1 ;
+      contact.atom2 = atom2 ;
+      contact.dist = dist ;
+      outbuf_write(query->out, &contact, sizeof(contact)) ;
+
+   } else {
+      const atomtext_t *text = query->atomtext ;
+      int len1 = text->start[atom1 + 1] - text->start[atom1] ;
+      int len2 = text->start[atom2 + 1] - text->start[atom2] ;
+      char *line, *p ;
+
+      line = outbuf_reserve(query->out, (len1 + len2 + 2 * MAXNUMBERTEXT)) ;
+      p = line ;
+
+      if (query->model >= 0) {
+         p = format_int(p, atoms->modelnum[query->model]) ;
+         *p++ = '\t' ;
+      }
+
+      memcpy(p, (text->text + text->start[atom1]), len1) ;
+      p += len1 ;
+      memcpy(p, (text->text + text->start[atom2]), len2) ;
+      p += len2 ;
+      p = format_distance(p, dist) ;
+      *p++ = '\n' ;
+
+      query->out->len += (p - line) ;
+   }
+}
+
+
+/* query_vs_node: classifies a node box against the query sphere from the
+   squared distances of the box's nearest and farthest points to the
+   center: EMPTY if even the nearest lies beyond the padded radius2,
+   CONTAINED if even the farthest lies within the shrunk inner2, so that no
+   point of the node can be misclassified by rounding, else INTERSECT */
+range_range_t query_vs_node( const float *bound_min, const float *bound_max, kdquery_t *query )
+{
+   float near2 = 0.0 ;
+   float far2 = 0.0 ;
+   int i ;
+
+#ifdef DEBUG
+   fprintf(stderr, "*** Node:\t%f - %f\t%f - %f\t%f - %f\n", bound_min[0], bound_max[0], bound_min[1], bound_max[1], bound_min[2], bound_max[2]) ;
+#endif
+
+   for (i = 0; i < 3; i++) {
+      float below = query->center[i] - bound_min[i] ;   // < 0: center below the box
+      float above = bound_max[i] - query->center[i] ;   // < 0: center above the box
+      float nearside = 0.0 ;
+      float farside = (below > above) ? below : above ;
+
+      if (below < 0.0) {
+         nearside = below ;
+      } else if (above < 0.0) {
+         nearside = above ; }
+
+      near2 += nearside * nearside ;
+      if (near2 > query->radius2) {
+         return EMPTY ; }
+
+      far2 += farside * farside ;
+   }
+
+   if (far2 <= query->inner2) {
+      return CONTAINED ; }
+
+   return INTERSECT ;
+}
+
+
+
+/* readinatoms: reads in ATOM records from fp and returns a pointer to a
+   readinatoms)_t struct with a pointer to an array of atom_t structs,
+   the number of atoms, and the coordinate minimum and maximum along each
+   dimension. A struct from an earlier call can be passed in as reuse to
+   read into its atom array. mmCIF files are handed to readincifatoms().
+   Reading stops at the first ENDMDL unless params->all_models is set;
+   HETATM records are only read with params->ligands. A file that can not
+   be read leaves a message in the error field */
+readinatoms_t *readinatoms (pdbreader_t *fp, readinatoms_t *reuse, kdparams_t *params)
+{
+   const char *line ;
+   int len ;
+   int endmdl = 0 ;
+
+   int i, j, d ;
+   readinatoms_t *result ;
+
+
+   if (reuse != NULL) {
+      result = reuse ;
+
+   } else {
+      result = malloc(sizeof(readinatoms_t)) ;
+      if (result == NULL) {
+         Error("Out of memory on result malloc()\n") ;
+      }
+
+      result->size = INITNUMATOMS ;
+      result->details = malloc(result->size * sizeof(atom_t)) ;
+      if (result->details == NULL) {
+         Error("Out of memory on details malloc()\n") ;
+      }
+
+      result->vdwradius = NULL ;
+
+      result->modelsize = INITNUMMODELS ;
+      result->modelstart = malloc((result->modelsize + 1) * sizeof(int)) ;
+      result->modelnum = malloc(result->modelsize * sizeof(int)) ;
+      if ((result->modelstart == NULL) || (result->modelnum == NULL)) {
+         Error("Out of memory on models malloc()\n") ;
+      }
+   }
+   result->number = 0 ;
+   result->nummodels = 0 ;
+   result->error[0] = '\0' ;
+
+
+   j = 1;
+   while (j && pdb_nextline(fp, &line, &len)) {
+
+      if (pdb_is_atom(line, len) ||
+          (params->ligands && pdb_is_hetatm(line, len))) {
+         atom_t *atom ;
+
+// atoms after an ENDMDL without a following MODEL record start a new model
+         if ((result->nummodels == 0) || endmdl) {
+            new_model(result, ((result->nummodels > 0) ?
+                               (result->modelnum[result->nummodels - 1] + 1) : 1)) ;
+            endmdl = 0 ;
+         }
+         atom = new_atom(result) ;
+
+         atom->atomno = pdb_int(line, len, PDB_ATOMNO) ;
+         pdb_copy(line, len, PDB_ATOMNA, atom->atomna) ;
+         pdb_copy(line, len, PDB_ALTLOC, 1, atom->altloc) ;
+         pdb_copy(line, len, PDB_RESNA, atom->resna) ;
+         pdb_copy(line, len, PDB_CHAINID, 1, atom->chainid) ;
+         atom->resno = pdb_int(line, len, PDB_RESNO) ;
+         pdb_copy(line, len, PDB_INSCODE, 1, atom->inscode) ;
+         atom->coord[0] = pdb_float(line, len, PDB_X) ;
+         atom->coord[1] = pdb_float(line, len, PDB_Y) ;
+         atom->coord[2] = pdb_float(line, len, PDB_Z) ;
+         atom->occup = pdb_float(line, len, PDB_OCCUP) ;
+         atom->hetatm = (line[0] == 'H') ;
+
+// an unwanted ligand is only known once its residue name is read
+         if (atom->hetatm && ! keep_hetatm(params, atom->resna)) {
+            result->number-- ; }
+
+      } else if (pdb_is_model(line, len)) {
+
+         new_model(result, pdb_int(line, len, PDB_MODELNO)) ;
+         endmdl = 0 ;
+
+      } else if (pdb_is_endmdl(line, len)) {
+
+         j = params->all_models ;
+         endmdl = 1 ;
+
+      } else if ((result->number == 0) && cif_is_datablock(line, len)) {
+
+         readincifatoms(fp, result, params) ;
+         j = 0;
+
+      }
+
+   }
+
+   if ((result->error[0] == '\0') && (pdb_error(fp) != NULL)) {
+      snprintf(result->error, sizeof(result->error),
+               "can not read the pdb file: %s", pdb_error(fp)) ; }
+
+// mmCIF rows without a model number
+   if (result->nummodels == 0) {
+      result->modelstart[0] = 0 ;
+      result->modelnum[0] = 1 ;
+      result->nummodels = 1 ;
+   }
+   result->modelstart[result->nummodels] = result->number ;
+
+   for (i = 0; i < result->number; i++) {
+      for (d = 0; d < 3; d++) {
+         if ((i == 0) || (result->coord_min[d] > result->details[i].coord[d])) {
+            result->coord_min[d] = result->details[i].coord[d] ; }
+         if ((i == 0) || (result->coord_max[d] < result->details[i].coord[d])) {
+            result->coord_max[d] = result->details[i].coord[d] ; }
+      }
+   }
+
+   return result ;
+}
+
+
+/* new_atom: returns the next free atom_t of the atom list, growing it as
+   needed */
+atom_t *new_atom (readinatoms_t *atoms)
+{
+   if (atoms->number >= atoms->size) {
+      atom_t *newp;
+      atoms->size += ATOMBLOCKSIZE ;
+      newp = realloc(atoms->details, atoms->size * sizeof(atom_t)) ;
+
+      if (newp == NULL) {
+         Error("Out of Memmory on realloc()\n") ;
+      }
+
+      atoms->details = newp ;
+   }
+
+   return &atoms->details[atoms->number++] ;
+}
+
+
+/* keep_hetatm: true if a HETATM residue passes --ligand-names and
+   --no-waters */
+int keep_hetatm (kdparams_t *params, const char *resna)
+{
+   static const char *waters[] = {"HOH", "WAT", "DOD", "H2O"} ;
+   const char *name = params->ligand_names ;
+   int len ;
+   int j ;
+
+   while (*resna == ' ') {
+      resna++ ; }
+   len = strlen(resna) ;
+
+   if (params->no_waters) {
+      for (j = 0; j < 4; j++) {
+         if (strcmp(resna, waters[j]) == 0) {
+            return 0 ; }
+      }
+   }
+
+   if (name == NULL) {
+      return 1 ; }
+
+   while (*name != '\0') {
+      int namelen = strcspn(name, ",") ;
+
+      if ((namelen == len) && (strncmp(name, resna, len) == 0)) {
+         return 1 ; }
+      name += namelen ;
+      if (*name == ',') {
+         name++ ; }
+   }
+
+   return 0 ;
+}
+
+
+/* new_model: starts a new model at the next atom to be read; a model that
+   is still empty is renumbered instead */
+void new_model (readinatoms_t *atoms, int modelnum)
+{
+   int m = atoms->nummodels ;
+
+   if ((m > 0) && (atoms->modelstart[m - 1] == atoms->number)) {
+      atoms->modelnum[m - 1] = modelnum ;
+      return ;
+   }
+
+   if (m >= atoms->modelsize) {
+      int *newstart, *newnum ;
+      atoms->modelsize *= 2 ;
+      newstart = realloc(atoms->modelstart, (atoms->modelsize + 1) * sizeof(int)) ;
+      newnum = realloc(atoms->modelnum, atoms->modelsize * sizeof(int)) ;
+
+      if ((newstart == NULL) || (newnum == NULL)) {
+         Error("Out of Memmory on realloc()\n") ;
+      }
+
+      atoms->modelstart = newstart ;
+      atoms->modelnum = newnum ;
+   }
+
+   atoms->modelstart[m] = atoms->number ;
+   atoms->modelnum[m] = modelnum ;
+   atoms->nummodels++ ;
+}
+
+
+/* free_atoms: frees the atom list */
+void free_atoms (readinatoms_t *atoms)
+{
+   free(atoms->details) ;
+   free(atoms->vdwradius) ;
+   free(atoms->modelstart) ;
+   free(atoms->modelnum) ;
+   free(atoms) ;
+}
+
+
+/* readincifatoms: reads the ATOM rows of the _atom_site loop of an mmCIF
+   file, token by token as the lines stream past; everything else in the
+   file is only tokenized far enough to find that loop. Stops at the end
+   of the loop, or of the first model unless params->all_models is set.
+   HETATM rows are only read with params->ligands */
+void readincifatoms (pdbreader_t *fp, readinatoms_t *atoms, kdparams_t *params)
+{
+   static const char *itemnames[NUMCIFITEMS] = {
+      "group_PDB", "id", "type_symbol",
+      "label_atom_id", "auth_atom_id", "label_alt_id",
+      "label_comp_id", "auth_comp_id",
+      "label_asym_id", "auth_asym_id",
+      "label_seq_id", "auth_seq_id", "pdbx_PDB_ins_code",
+      "Cartn_x", "Cartn_y", "Cartn_z", "occupancy", "pdbx_PDB_model_num" } ;
+   enum { CIF_OUTSIDE, CIF_LOOPHEADER, CIF_ROWS } state = CIF_OUTSIDE ;
+   int *colitem = NULL ;        // item of every loop column, -1 if unused
+   int numcols = 0 ;
+   int colsize = 0 ;
+   int atomsite = 0 ;
+   int col = 0 ;
+   int textfield = 0 ;
+   char model[CIFVALUELENGTH] = "" ;
+   cifrow_t row ;
+   atom_t *atom ;
+   const char *chainid ;
+   int hetatm ;
+   const char *line ;
+   int len ;
+   int done = 0 ;
+   int k ;
+
+   while ((! done) && pdb_nextline(fp, &line, &len)) {
+      const char *tok ;
+      int toklen, quoted ;
+      int pos = 0 ;
+      int textvalue = 0 ;
+
+// a text field counts as one (unused) value, taken at its closing ;
+      if (cif_textfield_line(line, len)) {
+         textfield = ! textfield ;
+         if (textfield) {
+            continue ; }
+         textvalue = 1 ;
+         pos = 1 ;
+      } else if (textfield) {
+         continue ;
+      }
+
+      while (! done) {
+         int is_loop ;
+         int is_tag ;
+
+         if (textvalue) {
+            tok = "" ;
+            toklen = 0 ;
+            quoted = 1 ;
+            textvalue = 0 ;
+         } else if (! cif_token(line, len, &pos, &tok, &toklen, &quoted)) {
+            break ;
+         }
+
+         is_loop = ((! quoted) && (toklen == 5) && (strncmp(tok, "loop_", 5) == 0)) ;
+         is_tag = ((! quoted) && (toklen > 0) && (tok[0] == '_')) ;
+
+         if ((state == CIF_ROWS) && (is_loop || is_tag ||
+             ((! quoted) && (toklen >= 5) && (strncmp(tok, "data_", 5) == 0)))) {
+            done = 1 ;
+            break ;
+         }
+
+         if (is_loop) {
+            state = CIF_LOOPHEADER ;
+            numcols = 0 ;
+            atomsite = 0 ;
+            continue ;
+         }
+
+         if ((state == CIF_LOOPHEADER) && is_tag) {
+            if (numcols >= colsize) {
+               int *newp ;
+               colsize += NUMCIFITEMS ;
+               newp = realloc(colitem, colsize * sizeof(int)) ;
+               if (newp == NULL) {
+                  Error("Out of Memmory on realloc()\n") ; }
+               colitem = newp ;
+            }
+
+            colitem[numcols] = -1 ;
+            if ((toklen > 11) && (strncmp(tok, "_atom_site.", 11) == 0)) {
+               atomsite = 1 ;
+               for (k = 0; k < NUMCIFITEMS; k++) {
+                  if (((int) strlen(itemnames[k]) == toklen - 11) &&
+                      (strncmp(itemnames[k], (tok + 11), toklen - 11) == 0)) {
+                     colitem[numcols] = k ; }
+               }
+            }
+            numcols++ ;
+            continue ;
+         }
+
+         if (state == CIF_LOOPHEADER) {
+            state = atomsite ? CIF_ROWS : CIF_OUTSIDE ;
+            col = 0 ;
+            for (k = 0; k < NUMCIFITEMS; k++) {
+               row.len[k] = -1 ; }
+         }
+
+         if (state != CIF_ROWS) {
+            continue ; }
+
+         k = colitem[col] ;
+         if ((k >= 0) && (! cif_is_null(tok, toklen, quoted))) {
+            row.len[k] = (toklen < CIFVALUELENGTH) ? toklen : (CIFVALUELENGTH - 1) ;
+            memcpy(row.value[k], tok, row.len[k]) ;
+            row.value[k][row.len[k]] = '\0' ;
+         } else if (k >= 0) {
+            row.len[k] = -1 ;
+         }
+
+         if (++col < numcols) {
+            continue ; }
+         col = 0 ;
+
+         if ((row.len[CIF_MODEL] >= 0) &&
+             ((model[0] == '\0') || (strcmp(model, row.value[CIF_MODEL]) != 0))) {
+            if ((model[0] != '\0') && (! params->all_models)) {
+               done = 1 ;
+               break ;
+            }
+            strcpy(model, row.value[CIF_MODEL]) ;
+            new_model(atoms, atoi(model)) ;
+         }
+
+         hetatm = (row.len[CIF_GROUP] >= 0) &&
+                  (strcmp(row.value[CIF_GROUP], "HETATM") == 0) ;
+         if ((row.len[CIF_GROUP] >= 0) && (! hetatm) &&
+             (strcmp(row.value[CIF_GROUP], "ATOM") != 0)) {
+            continue ; }
+         if (hetatm && (! params->ligands)) {
+            continue ; }
+
+// chain ids are kept whole, as cutting them could merge two chains
+         chainid = cifrow_item(&row, CIF_AUTH_ASYM_ID, CIF_LABEL_ASYM_ID, &k) ;
+         if (k > CHAINIDLENGTH) {
+            snprintf(atoms->error, sizeof(atoms->error),
+                     "mmCIF chain id %s is longer than %d chars", chainid,
+                     CHAINIDLENGTH) ;
+            done = 1 ;
+            break ;
+         }
+
+         atom = new_atom(atoms) ;
+         cifrow_to_atom(&row, atom) ;
+         if (hetatm) {
+            atom->hetatm = 1 ;
+            if (! keep_hetatm(params, atom->resna)) {
+               atoms->number-- ; }
+         }
+      }
+   }
+
+   free(colitem) ;
+}
+
+
+/* cifrow_item: returns the preferred item of a row, or the fallback item
+   if the preferred one is missing; NULL if both are */
+const char *cifrow_item (cifrow_t *row, cifitem_t preferred, cifitem_t fallback, int *len)
+{
+   if (row->len[preferred] >= 0) {
+      *len = row->len[preferred] ;
+      return row->value[preferred] ;
+   }
+   if (row->len[fallback] >= 0) {
+      *len = row->len[fallback] ;
+      return row->value[fallback] ;
+   }
+   *len = 0 ;
+   return NULL ;
+}
+
+
+/* cifrow_to_atom: fills an atom_t from an _atom_site row, laying the atom
+   and residue names out in their PDB columns (one letter elements start in
+   the second column, residue names are right-justified in three) so that
+   names compare and print as they do for PDB files */
+void cifrow_to_atom (cifrow_t *row, atom_t *atom)
+{
+   const char *v ;
+   int len ;
+
+   v = cifrow_item(row, CIF_ID, CIF_ID, &len) ;
+   atom->atomno = (v != NULL) ? pdb_int(v, len, 0, len) : 0 ;
+
+   v = cifrow_item(row, CIF_AUTH_ATOM_ID, CIF_LABEL_ATOM_ID, &len) ;
+   if (v == NULL) {
+      strcpy(atom->atomna, "    ") ;
+   } else if ((len < 4) && ((row->len[CIF_TYPE_SYMBOL] < 0) ||
+                            (row->len[CIF_TYPE_SYMBOL] == 1))) {
+      snprintf(atom->atomna, sizeof(atom->atomna), " %-3.*s", len, v) ;
+   } else {
+      snprintf(atom->atomna, sizeof(atom->atomna), "%-4.*s", len, v) ;
+   }
+
+   v = cifrow_item(row, CIF_ALT_ID, CIF_ALT_ID, &len) ;
+   atom->altloc[0] = (v != NULL) ? v[0] : ' ' ;
+   atom->altloc[1] = '\0' ;
+
+   v = cifrow_item(row, CIF_AUTH_COMP_ID, CIF_LABEL_COMP_ID, &len) ;
+   snprintf(atom->resna, sizeof(atom->resna), "%3.*s", len, (v != NULL) ? v : "") ;
+
+   v = cifrow_item(row, CIF_AUTH_ASYM_ID, CIF_LABEL_ASYM_ID, &len) ;
+   snprintf(atom->chainid, sizeof(atom->chainid), "%.*s", len, (v != NULL) ? v : "") ;
+
+   v = cifrow_item(row, CIF_AUTH_SEQ_ID, CIF_LABEL_SEQ_ID, &len) ;
+   atom->resno = (v != NULL) ? pdb_int(v, len, 0, len) : 0 ;
+
+   v = cifrow_item(row, CIF_INS_CODE, CIF_INS_CODE, &len) ;
+   atom->inscode[0] = (v != NULL) ? v[0] : ' ' ;
+   atom->inscode[1] = '\0' ;
+
+   v = cifrow_item(row, CIF_X, CIF_X, &len) ;
+   atom->coord[0] = (v != NULL) ? pdb_float(v, len, 0, len) : 0.0 ;
+   v = cifrow_item(row, CIF_Y, CIF_Y, &len) ;
+   atom->coord[1] = (v != NULL) ? pdb_float(v, len, 0, len) : 0.0 ;
+   v = cifrow_item(row, CIF_Z, CIF_Z, &len) ;
+   atom->coord[2] = (v != NULL) ? pdb_float(v, len, 0, len) : 0.0 ;
+
+   v = cifrow_item(row, CIF_OCCUPANCY, CIF_OCCUPANCY, &len) ;
+   atom->occup = (v != NULL) ? pdb_float(v, len, 0, len) : 1.0 ;
+
+   atom->hetatm = 0 ;
+}
+
+
+/* readinresidues: assigns every atom to a residue, keyed on chain, resno and
+   inscode (and on ATOM vs HETATM, so a ligand never joins a protein
+   residue), and ranks the residues by their resno\nchain signature so that
+   residue pairs can be oriented the same way as in calc/interfaces.pm */
+readinresidues_t *readinresidues (readinatoms_t *atoms)
+{
+   readinresidues_t *result ;
+   int *slots ;
+   int numslots ;
+   residuesig_t *sigs ;
+   int i, j ;
+
+   result = malloc(sizeof(readinresidues_t)) ;
+   if (result == NULL) {
+      Error("Out of memory on residues malloc()\n") ; }
+
+   result->details = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(residue_t)) ;
+   result->atomres = malloc((atoms->number > 0 ? atoms->number : 1) * sizeof(int)) ;
+   if ((result->details == NULL) || (result->atomres == NULL)) {
+      Error("Out of memory on residues malloc()\n") ; }
+   result->atomclass = NULL ;
+
+   numslots = 1 ;
+   while (numslots < 2 * atoms->number) {
+      numslots *= 2 ; }
+   slots = malloc(numslots * sizeof(int)) ;
+   if (slots == NULL) {
+      Error("Out of memory on residue hash malloc()\n") ; }
+   for (j = 0; j < numslots; j++) {
+      slots[j] = -1 ; }
+
+   result->number = 0 ;
+   for (i = 0; i < atoms->number; i++) {
+      atom_t *a = &atoms->details[i] ;
+      const char *chainid = (a->chainid[0] != '\0') ? a->chainid : " " ;
+      char inscode = (a->inscode[0] != ' ') ? a->inscode[0] : '\0' ;
+      unsigned int chainhash = 0 ;
+      unsigned int h ;
+
+      for (j = 0; chainid[j] != '\0'; j++) {
+         chainhash = 31 * chainhash + (unsigned char) chainid[j] ; }
+
+      h = (((unsigned int) a->resno * 2654435761U) ^
+           (chainhash << 8) ^ ((unsigned int) a->hetatm << 7) ^
+           (unsigned int) (unsigned char) inscode) & (numslots - 1) ;
+
+      while (slots[h] >= 0) {
+         residue_t *r = &result->details[slots[h]] ;
+         atom_t *first = &atoms->details[r->rank] ;
+
+         if ((first->resno == a->resno) && (first->hetatm == a->hetatm) &&
+             (strcmp(r->chainid, chainid) == 0) &&
+             (((first->inscode[0] != ' ') ? first->inscode[0] : '\0') == inscode)) {
+            break ; }
+         h = (h + 1) & (numslots - 1) ;
+      }
+
+      if (slots[h] < 0) {
+         residue_t *r = &result->details[result->number] ;
+
+         sprintf(r->resno, "%d%c", a->resno, inscode) ;
+         strcpy(r->chainid, chainid) ;
+         strcpy(r->resna, a->resna) ;
+         r->rank = i ;           // first atom, until the residues are ranked
+         slots[h] = result->number++ ;
+      }
+
+      result->atomres[i] = slots[h] ;
+   }
+
+   free(slots) ;
+
+   sigs = malloc((result->number > 0 ? result->number : 1) * sizeof(residuesig_t)) ;
+   if (sigs == NULL) {
+      Error("Out of memory on residue rank malloc()\n") ; }
+
+   for (j = 0; j < result->number; j++) {
+      sprintf(sigs[j].sig, "%s\n%s", result->details[j].resno, result->details[j].chainid) ;
+      sigs[j].residue = j ;
+   }
+
+   qsort(sigs, result->number, sizeof(residuesig_t), residuesig_cmp) ;
+
+   for (j = 0; j < result->number; j++) {
+      result->details[sigs[j].residue].rank = j ; }
+
+   result->sigs = sigs ;
+
+   return result ;
+}
+
+
+/* free_residues: frees the residue table */
+void free_residues (readinresidues_t *residues)
+{
+   free(residues->details) ;
+   free(residues->atomres) ;
+   free(residues->atomclass) ;
+   free(residues->sigs) ;
+   free(residues) ;
+}
+
+
+/* residuesig_cmp: qsort() comparison of residue signatures */
+int residuesig_cmp (const void *a, const void *b)
+{
+   return strcmp(((const residuesig_t *) a)->sig, ((const residuesig_t *) b)->sig) ;
+}
+
+
+/* readinspecials: reads the special contact thresholds and atom tables from
+   a tab-delimited parameter file (see special_contacts.params) and fills in
+   the atom class pair table */
+specialparams_t *readinspecials (char *fn)
+{
+   FILE *fp ;
+   char line[MAXPARAMLINELENGTH] ;
+   char *fields[4] ;
+   int numfields ;
+   int listsize = INITNUMSPECIALS ;
+   specialparams_t *result ;
+   int c1, c2 ;
+   int j ;
+
+   fp = fopen(fn, "r") ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: special contact parameter file %s does not exist\n", fn) ;
+      exit(1) ;
+   }
+
+   result = malloc(sizeof(specialparams_t)) ;
+   if (result == NULL) {
+      Error("Out of memory on specials malloc()\n") ; }
+
+   result->entries = malloc(listsize * sizeof(specialentry_t)) ;
+   if (result->entries == NULL) {
+      Error("Out of memory on specials malloc()\n") ; }
+
+   for (j = 0; j < NUMSPECIALTHRESH; j++) {
+      result->thresh[j] = -1 ; }
+   result->number = 0 ;
+
+   while (fgets(line, sizeof(line), fp)) {
+
+      line[strcspn(line, "\r\n")] = '\0' ;
+      if ((line[0] == '#') || (line[0] == '\0')) {
+         continue ; }
+
+      numfields = 0 ;
+      fields[numfields++] = line ;
+      while ((numfields < 4) &&
+             ((fields[numfields] = strchr(fields[numfields - 1], '\t')) != NULL)) {
+         *(fields[numfields]++) = '\0' ;
+         numfields++ ;
+      }
+
+      if ((strcmp(fields[0], "thresh") == 0) && (numfields == 3)) {
+         long microdist = lrint(atof(fields[2]) * 1e6) ;
+
+         if (strcmp(fields[1], "ssbond") == 0) {
+            result->thresh[THRESH_SSBOND] = microdist ;
+         } else if (strcmp(fields[1], "salt") == 0) {
+            result->thresh[THRESH_SALT] = microdist ;
+         } else if (strcmp(fields[1], "hbond") == 0) {
+            result->thresh[THRESH_HBOND] = microdist ;
+         } else if (strcmp(fields[1], "hbond_s") == 0) {
+            result->thresh[THRESH_HBOND_S] = microdist ;
+         } else {
+            fprintf(stderr, "ERROR: unknown threshold %s in %s\n", fields[1], fn) ;
+            exit(1) ;
+         }
+
+      } else if (((strcmp(fields[0], "hbond") == 0) ||
+                  (strcmp(fields[0], "salt") == 0)) && (numfields == 4)) {
+         specialentry_t *entry ;
+
+         if (result->number >= listsize) {
+            specialentry_t *newp ;
+            listsize += INITNUMSPECIALS ;
+            newp = realloc(result->entries, listsize * sizeof(specialentry_t)) ;
+            if (newp == NULL) {
+               Error("Out of Memmory on realloc()\n") ; }
+            result->entries = newp ;
+         }
+
+         entry = &result->entries[result->number++] ;
+         entry->type = (fields[0][0] == 'h') ? SPECIAL_HBOND : SPECIAL_SALT ;
+         strncpy(entry->resna, fields[1], 3) ;
+         entry->resna[3] = '\0' ;
+         strncpy(entry->atomna, fields[2], 4) ;
+         entry->atomna[4] = '\0' ;
+         entry->flag = atoi(fields[3]) ;
+
+         if ((entry->flag < -1) || (entry->flag > 1)) {
+            fprintf(stderr, "ERROR: %s flag for %s %s in %s must be -1, 0 or 1\n",
+                    fields[0], fields[1], fields[2], fn) ;
+            exit(1) ;
+         }
+
+      } else {
+         fprintf(stderr, "ERROR: can not parse line in %s: %s\n", fn, line) ;
+         exit(1) ;
+      }
+   }
+
+   fclose(fp) ;
+
+   for (j = 0; j < NUMSPECIALTHRESH; j++) {
+      if (result->thresh[j] < 0) {
+         fprintf(stderr, "ERROR: %s is missing a threshold\n", fn) ;
+         exit(1) ;
+      }
+   }
+
+// atom class = hbond flag + 4 * salt flag + 16 * sulfur (0 none, 1 SD, 2 SG)
+   for (c1 = 0; c1 < NUMATOMCLASSES; c1++) {
+      for (c2 = 0; c2 < NUMATOMCLASSES; c2++) {
+         int hb1 = c1 % 4, hb2 = c2 % 4 ;
+         int sb1 = (c1 / 4) % 4, sb2 = (c2 / 4) % 4 ;
+         int s1 = c1 / 16, s2 = c2 / 16 ;
+         unsigned char class = 0 ;
+
+         if ((s1 == 2) && (s2 == 2)) {
+            class |= PAIR_SSBOND ; }
+         if ((sb1 != FLAG_UNDEF) && (sb2 != FLAG_UNDEF) &&
+             ((sb1 - 2) + (sb2 - 2) == 0)) {
+            class |= PAIR_SALT ; }
+         if ((hb1 != FLAG_UNDEF) && (hb2 != FLAG_UNDEF) &&
+             (abs((hb1 - 2) + (hb2 - 2)) < 2)) {
+            class |= PAIR_HBOND ; }
+         if ((s1 != 0) || (s2 != 0)) {
+            class |= PAIR_HBOND_S ; }
+
+         result->pairclass[c1][c2] = class ;
+      }
+   }
+
+   return result ;
+}
+
+
+/* special_flag_lookup: returns the stored (1 + flag) value of an atom for one
+   type of special contact, or FLAG_UNDEF. Entries for any residue take
+   precedence over residue specific ones, as in calc/interfaces.pm */
+int special_flag_lookup (specialparams_t *specials, special_t type, char *resna, char *atomna)
+{
+   int found = FLAG_UNDEF ;
+   int j ;
+
+   for (j = 0; j < specials->number; j++) {
+      specialentry_t *entry = &specials->entries[j] ;
+
+      if ((entry->type != type) || (strcmp(entry->atomna, atomna) != 0)) {
+         continue ; }
+
+      if (strcmp(entry->resna, "*") == 0) {
+         return entry->flag + 2 ;
+      } else if ((found == FLAG_UNDEF) && (strcmp(entry->resna, resna) == 0)) {
+         found = entry->flag + 2 ;
+      }
+   }
+
+   return found ;
+}
+
+
+/* classify_atoms: assigns every atom its special contact class */
+void classify_atoms (readinresidues_t *residues, readinatoms_t *atoms, specialparams_t *specials)
+{
+   int i ;
+
+   residues->atomclass = malloc((atoms->number > 0 ? atoms->number : 1)) ;
+   if (residues->atomclass == NULL) {
+      Error("Out of memory on atom class malloc()\n") ; }
+
+   for (i = 0; i < atoms->number; i++) {
+      atom_t *a = &atoms->details[i] ;
+      int sulfur = 0 ;
+
+      if ((i > 0) &&
+          (strcmp(a->atomna, atoms->details[i - 1].atomna) == 0) &&
+          (strcmp(a->resna, atoms->details[i - 1].resna) == 0)) {
+         residues->atomclass[i] = residues->atomclass[i - 1] ;
+         continue ;
+      }
+
+      if (strcmp(a->atomna, " SD ") == 0) {
+         sulfur = 1 ;
+      } else if (strcmp(a->atomna, " SG ") == 0) {
+         sulfur = 2 ;
+      }
+
+      residues->atomclass[i] =
+         special_flag_lookup(specials, SPECIAL_HBOND, a->resna, a->atomna) +
+         4 * special_flag_lookup(specials, SPECIAL_SALT, a->resna, a->atomna) +
+         16 * sulfur ;
+   }
+}
+
+
+/* readincutoffs: reads a comma-separated list of ascending residue pair
+   distance cutoffs */
+void readincutoffs (char *list, kdparams_t *params)
+{
+   char *pos = list ;
+   char *rest ;
+
+   params->numcutoffs = 0 ;
+   while (*pos != '\0') {
+      double cutoff = strtod(pos, &rest) ;
+
+      if ((rest == pos) || ((*rest != ',') && (*rest != '\0')) || (cutoff < 0)) {
+         fprintf(stderr, "ERROR: bad distance cutoff list %s\n", list) ;
+         exit(1) ;
+      }
+      if (params->numcutoffs >= MAXRESPAIRCUTOFFS) {
+         fprintf(stderr, "ERROR: more than %d distance cutoffs in %s\n", MAXRESPAIRCUTOFFS, list) ;
+         exit(1) ;
+      }
+
+      params->cutoffs[params->numcutoffs] = lrint(cutoff * 1e6) ;
+      if ((params->numcutoffs > 0) &&
+          (params->cutoffs[params->numcutoffs] <= params->cutoffs[params->numcutoffs - 1])) {
+         fprintf(stderr, "ERROR: distance cutoffs must be ascending: %s\n", list) ;
+         exit(1) ;
+      }
+      params->numcutoffs++ ;
+
+      pos = (*rest == ',') ? (rest + 1) : rest ;
+   }
+
+   if (params->numcutoffs == 0) {
+      Error("ERROR: --cutoffs needs at least one distance") ; }
+}
+
+
+/* readinvdw: reads the tolerance and the van der Waals radii by element
+   from a --vdw parameter file */
+vdwparams_t *readinvdw (char *fn)
+{
+   FILE *fp ;
+   char line[MAXPARAMLINELENGTH] ;
+   char *fields[3] ;
+   int numfields ;
+   vdwparams_t *result ;
+
+   fp = fopen(fn, "r") ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: van der Waals parameter file %s does not exist\n", fn) ;
+      exit(1) ;
+   }
+
+   result = malloc(sizeof(vdwparams_t)) ;
+   if (result == NULL) {
+      Error("Out of memory on vdw malloc()\n") ; }
+
+   result->tolerance = -1 ;
+   result->defaultradius = -1 ;
+   result->number = 0 ;
+
+   while (fgets(line, sizeof(line), fp)) {
+
+      line[strcspn(line, "\r\n")] = '\0' ;
+      if ((line[0] == '#') || (line[0] == '\0')) {
+         continue ; }
+
+      numfields = 0 ;
+      fields[numfields++] = line ;
+      while ((numfields < 3) &&
+             ((fields[numfields] = strchr(fields[numfields - 1], '\t')) != NULL)) {
+         *(fields[numfields]++) = '\0' ;
+         numfields++ ;
+      }
+
+      if ((strcmp(fields[0], "tolerance") == 0) && (numfields == 2)) {
+         result->tolerance = atof(fields[1]) ;
+
+      } else if ((strcmp(fields[0], "radius") == 0) && (numfields == 3)) {
+         if (strcmp(fields[1], "*") == 0) {
+            result->defaultradius = atof(fields[2]) ;
+            continue ;
+         }
+
+         if (result->number >= MAXVDWTYPES) {
+            fprintf(stderr, "ERROR: more than %d elements in %s\n", MAXVDWTYPES, fn) ;
+            exit(1) ;
+         }
+         strncpy(result->element[result->number], fields[1], 2) ;
+         result->element[result->number][2] = '\0' ;
+         result->radius[result->number] = atof(fields[2]) ;
+         result->number++ ;
+
+      } else {
+         fprintf(stderr, "ERROR: can not parse line in %s: %s\n", fn, line) ;
+         exit(1) ;
+      }
+   }
+
+   fclose(fp) ;
+
+   if ((result->tolerance < 0) || (result->defaultradius < 0)) {
+      fprintf(stderr, "ERROR: %s needs a tolerance and a * radius\n", fn) ;
+      exit(1) ;
+   }
+
+   return result ;
+}
+
+
+/* assign_vdwradii: looks up the van der Waals radius of every atom. The
+   element is read from the first two columns of the atom name: a known
+   two letter element (FE, CL) there, else the first column, unless it is
+   blank or a digit, in which case the element is the second column */
+void assign_vdwradii (readinatoms_t *atoms, vdwparams_t *vdw)
+{
+   float *newp ;
+   int i, k ;
+
+   newp = realloc(atoms->vdwradius, (atoms->size > 0 ? atoms->size : 1) * sizeof(float)) ;
+   if (newp == NULL) {
+      Error("Out of Memmory on realloc()\n") ; }
+   atoms->vdwradius = newp ;
+
+   for (i = 0; i < atoms->number; i++) {
+      const char *atomna = atoms->details[i].atomna ;
+      char element = atomna[1] ;
+      int found = 0 ;
+
+      if ((atomna[0] != ' ') && ((atomna[0] < '0') || (atomna[0] > '9'))) {
+         element = atomna[0] ;
+         for (k = 0; (k < vdw->number) && (! found); k++) {
+            if ((vdw->element[k][0] == atomna[0]) &&
+                (vdw->element[k][1] == atomna[1]) && (atomna[1] != '\0')) {
+               atoms->vdwradius[i] = vdw->radius[k] ;
+               found = 1 ;
+            }
+         }
+      }
+
+      for (k = 0; (k < vdw->number) && (! found); k++) {
+         if ((vdw->element[k][0] == element) && (vdw->element[k][1] == '\0')) {
+            atoms->vdwradius[i] = vdw->radius[k] ;
+            found = 1 ;
+         }
+      }
+
+      if (! found) {
+         atoms->vdwradius[i] = vdw->defaultradius ; }
+   }
+}
+
+
+/* set_search_radius: widens the sphere radius to what --cutoffs and --vdw
+   need */
+void set_search_radius (kdparams_t *params)
+{
+   if (params->shells &&
+       (params->radius < params->cutoffs[params->numcutoffs - 1] / 1e6)) {
+      params->radius = params->cutoffs[params->numcutoffs - 1] / 1e6 ; }
+
+   if (params->vdw != NULL) {
+      vdwparams_t *vdw = params->vdw ;
+      int k ;
+
+      vdw->maxradius = vdw->defaultradius ;
+      for (k = 0; k < vdw->number; k++) {
+         if (vdw->radius[k] > vdw->maxradius) {
+            vdw->maxradius = vdw->radius[k] ; }
+      }
+
+      params->radius = 2 * vdw->maxradius + vdw->tolerance ;
+   }
+}
+
+
+/* select_scan_kernel: returns the named leaf scanning kernel, or with no
+   name the widest one this CPU supports */
+scankernel_t select_scan_kernel( char *name )
+{
+   if (name == NULL) {
+#ifdef KDCONTACTS_X86
+      __builtin_cpu_init() ;
+      if (__builtin_cpu_supports("avx2")) {
+         return scan_points_avx2 ; }
+      if (__builtin_cpu_supports("sse2")) {
+         return scan_points_sse2 ; }
+#endif
+      return scan_points_scalar ;
+   }
+
+   if (strcmp(name, "scalar") == 0) {
+      return scan_points_scalar ; }
+
+#ifdef KDCONTACTS_X86
+   __builtin_cpu_init() ;
+   if ((strcmp(name, "sse2") == 0) && __builtin_cpu_supports("sse2")) {
+      return scan_points_sse2 ; }
+   if ((strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+      return scan_points_avx2 ; }
+#endif
+
+   fprintf(stderr, "ERROR: scan kernel %s is not available on this machine\n", name) ;
+   exit(1) ;
+}
+
+
+/* scan_points_scalar: portable leaf scanning kernel */
+int scan_points_scalar (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits)
+{
+   int numhits = 0 ;
+   int j ;
+
+   for (j = lo; j < hi; j++) {
+      float dx = x[j] - center[0] ;
+      float dy = y[j] - center[1] ;
+      float dz = z[j] - center[2] ;
+
+      if (dx * dx + dy * dy + dz * dz <= radius2) {
+         hits[numhits++] = j ; }
+   }
+
+   return numhits ;
+}
+
+
+#ifdef KDCONTACTS_X86
+
+/* scan_points_sse2: leaf scanning kernel, 4 points at a time */
+__attribute__((target("sse2")))
+int scan_points_sse2 (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits)
+{
+   __m128 cx = _mm_set1_ps(center[0]) ;
+   __m128 cy = _mm_set1_ps(center[1]) ;
+   __m128 cz = _mm_set1_ps(center[2]) ;
+   __m128 r2 = _mm_set1_ps(radius2) ;
+   int numhits = 0 ;
+   int j ;
+
+   for (j = lo; j + 4 <= hi; j += 4) {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + j), cx) ;
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + j), cy) ;
+      __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + j), cz) ;
+      __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                             _mm_mul_ps(dz, dz)) ;
+      int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2)) ;
+
+      while (mask) {
+         hits[numhits++] = j + __builtin_ctz(mask) ;
+         mask &= mask - 1 ;
+      }
+   }
+
+   return numhits + scan_points_scalar(x, y, z, j, hi, center, radius2, (hits + numhits)) ;
+}
+
+
+/* scan_points_avx2: leaf scanning kernel, 8 points at a time */
+__attribute__((target("avx2")))
+int scan_points_avx2 (const float *x, const float *y, const float *z, int lo, int hi, const float *center, float radius2, int *hits)
+{
+   __m256 cx = _mm256_set1_ps(center[0]) ;
+   __m256 cy = _mm256_set1_ps(center[1]) ;
+   __m256 cz = _mm256_set1_ps(center[2]) ;
+   __m256 r2 = _mm256_set1_ps(radius2) ;
+   int numhits = 0 ;
+   int j ;
+
+   for (j = lo; j + 8 <= hi; j += 8) {
+      __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), cx) ;
+      __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), cy) ;
+      __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), cz) ;
+      __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                _mm256_mul_ps(dz, dz)) ;
+      int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ)) ;
+
+      while (mask) {
+         hits[numhits++] = j + __builtin_ctz(mask) ;
+         mask &= mask - 1 ;
+      }
+   }
+
+   for (; j < hi; j++) {
+      float dx = x[j] - center[0] ;
+      float dy = y[j] - center[1] ;
+      float dz = z[j] - center[2] ;
+
+      if (dx * dx + dy * dy + dz * dz <= radius2) {
+         hits[numhits++] = j ; }
+   }
+
+   return numhits ;
+}
+
+#endif
+
+
+/* eucliddist: determines the euclidean distance between two 3D points */
+float eucliddist (float a[3], float b[3])
+{
+   float distance ;
 
    distance = sqrt( (a[0] - b[0]) * (a[0] - b[0]) +
                     (a[1] - b[1]) * (a[1] - b[1]) +
@@ -872,3 +3307,391 @@ float eucliddist (float a[3], float b[3])
 
    return distance ;
 }
+
+
+/* add_respair_contact: adds an atom contact to the residue pair table of
+   the current thread, skipping hydrogens and intra-residue contacts */
+void add_respair_contact (kdquery_t *query, readinatoms_t *atoms, int atom1, int atom2, float dist)
+{
+   kdparams_t *params = query->params ;
+   readinresidues_t *residues = query->residues ;
+   respair_t *pair ;
+   int res1, res2 ;
+   long microdist ;
+   int k ;
+
+   if ((atoms->details[atom1].atomna[1] == 'H') ||
+       (atoms->details[atom1].atomna[1] == 'Q') ||
+       (atoms->details[atom2].atomna[1] == 'H') ||
+       (atoms->details[atom2].atomna[1] == 'Q')) {
+      return ; }
+
+   res1 = residues->atomres[atom1] ;
+   res2 = residues->atomres[atom2] ;
+   if (res1 == res2) {
+      return ; }
+
+// with --ligands the ligand residue comes first
+   if ((atoms->details[atom1].hetatm != atoms->details[atom2].hetatm) ?
+       atoms->details[atom2].hetatm :
+       (residues->details[res1].rank < residues->details[res2].rank)) {
+      int t = res1 ; res1 = res2 ; res2 = t ; }
+
+   pair = respair_lookup(query->respairs, res1, res2) ;
+
+// the atoms of a model are all queried in a row by the same thread
+   if (pair->lastmodel != query->model + 1) {
+      pair->lastmodel = query->model + 1 ;
+      pair->models++ ;
+   }
+
+   if ((pair->contacts == 0) || (dist < pair->min_dist)) {
+      pair->min_dist = dist ; }
+   pair->contacts++ ;
+
+// bin on the distance as printed by the text output (%f), like the perl code
+   microdist = lrint((double) dist * 1e6) ;
+   for (k = 0; k < params->numcutoffs; k++) {
+      if (microdist <= params->cutoffs[k]) {
+         pair->counts[k]++ ;
+         if (params->shells) {
+            break ; }
+      }
+   }
+
+   if (query->specials != NULL) {
+      specialparams_t *specials = query->specials ;
+      unsigned char class = specials->pairclass[residues->atomclass[atom1]][residues->atomclass[atom2]] ;
+
+      if ((class & PAIR_SSBOND) && (microdist <= specials->thresh[THRESH_SSBOND])) {
+         pair->specials[SPECIAL_SSBOND]++ ;
+      } else if ((class & PAIR_SALT) && (microdist <= specials->thresh[THRESH_SALT])) {
+         pair->specials[SPECIAL_SALT]++ ;
+      } else if ((class & PAIR_HBOND) &&
+                 (microdist < specials->thresh[(class & PAIR_HBOND_S) ? THRESH_HBOND_S : THRESH_HBOND])) {
+         pair->specials[SPECIAL_HBOND]++ ;
+      }
+   }
+}
+
+
+/* respair_lookup: returns the entry for a residue pair, adding an empty one
+   if it is not in the table yet */
+respair_t *respair_lookup (respairtable_t *table, int res1, int res2)
+{
+   unsigned int mask ;
+   unsigned int h ;
+
+   if (2 * (table->number + 1) > table->size) {
+      respairtable_t grown ;
+      int j ;
+
+      grown.number = 0 ;
+      grown.size = (table->size > 0) ? (2 * table->size) : INITRESPAIRSLOTS ;
+      grown.slots = malloc(grown.size * sizeof(respair_t)) ;
+      if (grown.slots == NULL) {
+         Error("Out of memory on residue pair malloc()\n") ; }
+      for (j = 0; j < grown.size; j++) {
+         grown.slots[j].res1 = -1 ; }
+
+      for (j = 0; j < table->size; j++) {
+         if (table->slots[j].res1 >= 0) {
+            *respair_lookup(&grown, table->slots[j].res1, table->slots[j].res2) = table->slots[j] ; }
+      }
+
+      free(table->slots) ;
+      *table = grown ;
+   }
+
+   mask = table->size - 1 ;
+   h = (((unsigned int) res1 * 2654435761U) ^ (unsigned int) res2) & mask ;
+
+   while (table->slots[h].res1 >= 0) {
+      if ((table->slots[h].res1 == res1) && (table->slots[h].res2 == res2)) {
+         return &table->slots[h] ; }
+      h = (h + 1) & mask ;
+   }
+
+   memset(&table->slots[h], 0, sizeof(respair_t)) ;
+   table->slots[h].res1 = res1 ;
+   table->slots[h].res2 = res2 ;
+   table->number++ ;
+
+   return &table->slots[h] ;
+}
+
+
+/* merge_respairs: adds the residue pair counts of one table to another */
+void merge_respairs (respairtable_t *to, respairtable_t *from)
+{
+   respair_t *pair ;
+   int j, k ;
+
+   for (j = 0; j < from->size; j++) {
+      if (from->slots[j].res1 < 0) {
+         continue ; }
+
+      pair = respair_lookup(to, from->slots[j].res1, from->slots[j].res2) ;
+
+      if ((pair->contacts == 0) || (from->slots[j].min_dist < pair->min_dist)) {
+         pair->min_dist = from->slots[j].min_dist ; }
+      pair->contacts += from->slots[j].contacts ;
+      for (k = 0; k < MAXRESPAIRCUTOFFS; k++) {
+         pair->counts[k] += from->slots[j].counts[k] ; }
+      for (k = 0; k < NUMSPECIALS; k++) {
+         pair->specials[k] += from->slots[j].specials[k] ; }
+      pair->models += from->slots[j].models ;
+   }
+}
+
+
+/* clear_respairs: empties a residue pair table, keeping its slots */
+void clear_respairs (respairtable_t *table)
+{
+   int j ;
+
+   for (j = 0; j < table->size; j++) {
+      table->slots[j].res1 = -1 ; }
+   table->number = 0 ;
+}
+
+
+/* display_respairs: displays the residue pairs, in input order of residue 1
+   and then residue 2. With nummodels > 0 (--all-models) the number and the
+   fraction of models in contact are added */
+void display_respairs (respairtable_t *table, readinresidues_t *residues, kdparams_t *params, int nummodels)
+{
+   specialparams_t *specials = params->specials ;
+   respair_t *pairs ;
+   int numpairs ;
+   int j, k ;
+
+   pairs = malloc((table->number > 0 ? table->number : 1) * sizeof(respair_t)) ;
+   if (pairs == NULL) {
+      Error("Out of memory on residue pair malloc()\n") ; }
+
+   numpairs = 0 ;
+   for (j = 0; j < table->size; j++) {
+      if (table->slots[j].res1 >= 0) {
+         pairs[numpairs++] = table->slots[j] ; }
+   }
+
+   qsort(pairs, numpairs, sizeof(respair_t), respair_cmp) ;
+
+   printf("%s\tresno2\tchain_id2\tresna2\tcontacts\tmin_dist",
+          (params->ligands ? "#lig_resno\tlig_chain_id\tlig_resna" : "#resno1\tchain_id1\tresna1")) ;
+
+// column names spell the cutoff with p for the decimal point: counts_4p5
+   for (k = 0; k < params->numcutoffs; k++) {
+      char name[32] ;
+      char *point ;
+
+      snprintf(name, sizeof(name), "%g", params->cutoffs[k] / 1e6) ;
+      if ((point = strchr(name, '.')) != NULL) {
+         *point = 'p' ; }
+      printf("\t%s_%s", (params->shells ? "shell" : "counts"), name) ;
+   }
+
+   printf("%s%s\n",
+          (specials != NULL) ? "\thbond\tsalt\tssbond" : "",
+          (nummodels > 0) ? "\tmodels\tfrequency" : "") ;
+
+   for (j = 0; j < numpairs; j++) {
+      residue_t *r1 = &residues->details[pairs[j].res1] ;
+      residue_t *r2 = &residues->details[pairs[j].res2] ;
+
+      printf("%s\t%s\t%s\t%s\t%s\t%s\t%d\t%f",
+             r1->resno, r1->chainid, r1->resna,
+             r2->resno, r2->chainid, r2->resna,
+             pairs[j].contacts, pairs[j].min_dist) ;
+
+      for (k = 0; k < params->numcutoffs; k++) {
+         printf("\t%d", pairs[j].counts[k]) ; }
+
+      if (specials != NULL) {
+         printf("\t%d\t%d\t%d", pairs[j].specials[SPECIAL_HBOND],
+                pairs[j].specials[SPECIAL_SALT], pairs[j].specials[SPECIAL_SSBOND]) ; }
+
+      if (nummodels > 0) {
+         printf("\t%d\t%f", pairs[j].models, (double) pairs[j].models / nummodels) ; }
+
+      printf("\n") ;
+   }
+
+   free(pairs) ;
+}
+
+
+/* respair_cmp: qsort() comparison of residue pairs by residue index */
+int respair_cmp (const void *a, const void *b)
+{
+   const respair_t *p = a ;
+   const respair_t *q = b ;
+
+   if (p->res1 != q->res1) {
+      return (p->res1 < q->res1) ? -1 : 1 ; }
+   if (p->res2 != q->res2) {
+      return (p->res2 < q->res2) ? -1 : 1 ; }
+   return 0 ;
+}
+
+
+/* write_binary_header: writes the binary format header and atom table */
+void write_binary_header (readinatoms_t *atoms, kdparams_t *params)
+{
+   kdcbin_header_t header ;
+   kdcbin_atom_t *table ;
+   int j ;
+
+   memset(&header, 0, sizeof(header)) ;
+   memcpy(header.magic, KDCBIN_MAGIC, 4) ;
+   header.byteorder = KDCBIN_BYTEORDER ;
+   header.version = KDCBIN_VERSION ;
+   header.numatoms = atoms->number ;
+   header.radius = params->radius ;
+   if (params->unique_pairs) {
+      header.flags |= KDCBIN_UNIQUE_PAIRS ; }
+
+   table = calloc((atoms->number > 0 ? atoms->number : 1), sizeof(kdcbin_atom_t)) ;
+   if (table == NULL) {
+      Error("Out of memory on atom table calloc()\n") ; }
+
+   for (j = 0; j < atoms->number; j++) {
+      table[j].atomno = atoms->details[j].atomno ;
+      table[j].resno = atoms->details[j].resno ;
+      memcpy(table[j].atomna, atoms->details[j].atomna, strlen(atoms->details[j].atomna)) ;
+      memcpy(table[j].resna, atoms->details[j].resna, strlen(atoms->details[j].resna)) ;
+      memcpy(table[j].chainid, atoms->details[j].chainid, strlen(atoms->details[j].chainid)) ;
+      table[j].inscode = atoms->details[j].inscode[0] ;
+      table[j].altloc = atoms->details[j].altloc[0] ;
+   }
+
+   fwrite(&header, sizeof(header), 1, stdout) ;
+   fwrite(table, sizeof(kdcbin_atom_t), atoms->number, stdout) ;
+   free(table) ;
+}
+
+
+/* outbuf_write: appends raw bytes to an output buffer, growing it as needed */
+void outbuf_write( outbuf_t *out, const void *data, size_t size )
+{
+   if (out->len + size > out->size) {
+      char *newp ;
+      out->size = 2 * (out->len + size) ;
+      newp = realloc(out->buf, out->size) ;
+      if (newp == NULL) {
+         Error("Out of Memmory on realloc()\n") ; }
+      out->buf = newp ;
+   }
+
+   memcpy((out->buf + out->len), data, size) ;
+   out->len += size ;
+}
+
+
+/* outbuf_reserve: makes room for size more bytes at the end of an output
+   buffer and returns where they go; the caller advances out->len by what it
+   writes */
+char *outbuf_reserve( outbuf_t *out, size_t size )
+{
+   if (out->len + size > out->size) {
+      char *newp ;
+      out->size = 2 * (out->len + size) ;
+      newp = realloc(out->buf, out->size) ;
+      if (newp == NULL) {
+         Error("Out of Memmory on realloc()\n") ; }
+      out->buf = newp ;
+   }
+
+   return (out->buf + out->len) ;
+}
+
+
+/* new_atomtext: formats the text output columns of every atom, exactly as
+   the "%s\t%d\t%s\t%s\t%d\t%s\t" of a contact line would */
+atomtext_t *new_atomtext( readinatoms_t *atoms )
+{
+   atomtext_t *result ;
+   char *p ;
+   int j ;
+
+   result = malloc(sizeof(atomtext_t)) ;
+   if (result == NULL) {
+      Error("Out of memory on atom text malloc()\n") ; }
+
+   result->text = malloc((atoms->number > 0 ? atoms->number : 1) * MAXATOMTEXT) ;
+   result->start = malloc((atoms->number + 1) * sizeof(int)) ;
+   if ((result->text == NULL) || (result->start == NULL)) {
+      Error("Out of memory on atom text malloc()\n") ; }
+
+   p = result->text ;
+   for (j = 0; j < atoms->number; j++) {
+      atom_t *atom = &atoms->details[j] ;
+
+      result->start[j] = p - result->text ;
+      p += snprintf(p, MAXATOMTEXT, "%s\t%d\t%s\t%s\t%d\t%s\t",
+                    atom->resna, atom->resno, atom->inscode, atom->chainid,
+                    atom->atomno, atom->atomna) ;
+   }
+   result->start[atoms->number] = p - result->text ;
+
+   return result ;
+}
+
+
+/* free_atomtext: frees the atom text table */
+void free_atomtext( atomtext_t *atomtext )
+{
+   free(atomtext->text) ;
+   free(atomtext->start) ;
+   free(atomtext) ;
+}
+
+
+/* format_int: writes value in decimal at p and returns the end of it */
+char *format_int( char *p, int value )
+{
+   char digits[12] ;
+   unsigned int v = (value < 0) ? -(unsigned int) value : (unsigned int) value ;
+   int n = 0 ;
+
+   if (value < 0) {
+      *p++ = '-' ; }
+
+   do {
+      digits[n++] = '0' + (v % 10) ;
+      v /= 10 ;
+   } while (v > 0) ;
+
+   while (n > 0) {
+      *p++ = digits[--n] ; }
+
+   return p ;
+}
+
+
+/* format_distance: writes dist at p as printf("%f") would and returns the
+   end of it. A float times 10^6 is exact in a double, so rint() rounds it
+   to 6 decimals the way printf() does, ties to even; anything unusual is
+   left to snprintf() */
+char *format_distance( char *p, float dist )
+{
+   unsigned long long v ;
+   unsigned int frac ;
+   int j ;
+
+   if (! ((dist >= 0.0) && (dist < 1.0e9)) || signbit(dist)) {
+      return p + snprintf(p, MAXNUMBERTEXT, "%f", dist) ; }
+
+   v = (unsigned long long) rint((double) dist * 1.0e6) ;
+   frac = (unsigned int) (v % 1000000) ;
+
+   p = format_int(p, (int) (v / 1000000)) ;
+   *p++ = '.' ;
+   for (j = 5; j >= 0; j--) {
+      p[j] = '0' + (frac % 10) ;
+      frac /= 10 ;
+   }
+
+   return p + 6 ;
+}
@@ -0,0 +1,81 @@
+/* kdcontacts_bin.h - Layout of the kdcontacts binary contact format
+
+Description: written by `kdcontacts -b' and read by kdcontacts_decode.
+All fields are in the byte order of the machine that wrote the file; the
+byteorder field of the header lets a reader detect a mismatch.
+
+   kdcbin_header_t             once
+   kdcbin_atom_t               header.numatoms times, in input order
+   kdcbin_contact_t            repeated until end of file
+
+Contacts refer to atoms by their position in the atom table. Strings in the
+atom table are fixed width and NUL padded, not NUL terminated; the chain id
+is 4 chars wide to hold mmCIF chain ids.
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef KDCONTACTS_BIN_H
+#define KDCONTACTS_BIN_H
+
+#include<stdint.h>
+
+#define KDCBIN_MAGIC "KDCB"
+#define KDCBIN_VERSION 1
+#define KDCBIN_BYTEORDER 0x01020304
+
+
+struct kdcbin_header_Struct {
+   char         magic[4] ;
+   uint32_t     byteorder ;
+   uint32_t     version ;
+   uint32_t     numatoms ;
+   float        radius ;
+   uint32_t     flags ;         // KDCBIN_UNIQUE_PAIRS
+} ;
+typedef struct kdcbin_header_Struct kdcbin_header_t ;
+
+#define KDCBIN_UNIQUE_PAIRS 1
+
+
+struct kdcbin_atom_Struct {
+   int32_t      atomno ;
+   int32_t      resno ;
+   char         atomna[4] ;
+   char         resna[3] ;
+   char         inscode ;
+   char         altloc ;
+   char         pad[3] ;
+   char         chainid[4] ;
+} ;
+typedef struct kdcbin_atom_Struct kdcbin_atom_t ;
+
+
+struct kdcbin_contact_Struct {
+   uint32_t     atom1 ;
+   uint32_t     atom2 ;
+   float        dist ;
+} ;
+typedef struct kdcbin_contact_Struct kdcbin_contact_t ;
+
+#endif
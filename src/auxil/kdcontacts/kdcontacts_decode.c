@@ -0,0 +1,172 @@
+/* kdcontacts_decode.c - Converts binary kdcontacts output back to text
+
+Description: Reads the binary contact format written by `kdcontacts -b'
+(see kdcontacts_bin.h) and prints the same tab-delimited table that
+kdcontacts writes in text mode.
+
+Usage: ./kdcontacts_decode [binary contacts file] > contacts
+Reads from STDIN if no file is given
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+#include "kdcontacts_bin.h"
+
+
+#define CONTACTBLOCKSIZE 4096
+#define Error( Str )   fprintf( stderr, "%s\n", Str ), exit( 1 )
+
+
+//STRUCTURES
+
+/* an atom table entry with NUL terminated strings, ready for printf() */
+struct decodedatom_Struct {
+   int          atomno ;
+   int          resno ;
+   char         atomna[5] ;
+   char         resna[4] ;
+   char         chainid[5] ;
+   char         inscode[2] ;
+} ;
+typedef struct decodedatom_Struct decodedatom_t ;
+
+
+
+//FUNCTION DECLARATION
+decodedatom_t *read_atom_table( FILE *fp, kdcbin_header_t *header ) ;
+
+void decode_contacts( FILE *fp, kdcbin_header_t *header, decodedatom_t *atoms ) ;
+
+
+
+int main(int argc, char *argv[])
+{
+   FILE *fp ;
+   kdcbin_header_t header ;
+   decodedatom_t *atoms ;
+
+   if (argc > 1 ) {
+      fp = fopen(argv[1], "rb") ;
+      if (fp == NULL) {
+         fprintf(stderr, "ERROR: contacts file %s does not exist\n", argv[1]) ;
+         exit(1) ;
+      }
+   } else {
+      fp = stdin ;
+   }
+
+   atoms = read_atom_table(fp, &header) ;
+   decode_contacts(fp, &header, atoms) ;
+
+   if (fp != stdin) {
+      fclose(fp) ; }
+
+   return 0;
+}
+
+
+
+/* read_atom_table: checks the header and reads in the atom table */
+decodedatom_t *read_atom_table( FILE *fp, kdcbin_header_t *header )
+{
+   kdcbin_atom_t rec ;
+   decodedatom_t *atoms ;
+   unsigned int j ;
+
+   if (fread(header, sizeof(kdcbin_header_t), 1, fp) != 1) {
+      Error("ERROR: truncated kdcontacts binary header") ; }
+
+   if (memcmp(header->magic, KDCBIN_MAGIC, 4) != 0) {
+      Error("ERROR: not a kdcontacts binary file") ; }
+
+   if (header->byteorder != KDCBIN_BYTEORDER) {
+      Error("ERROR: kdcontacts binary file was written with a different byte order") ; }
+
+   if (header->version != KDCBIN_VERSION) {
+      Error("ERROR: unsupported kdcontacts binary file version") ; }
+
+   atoms = malloc((header->numatoms > 0 ? header->numatoms : 1) * sizeof(decodedatom_t)) ;
+   if (atoms == NULL) {
+      Error("Out of memory on atoms malloc()\n") ; }
+
+   for (j = 0; j < header->numatoms; j++) {
+      if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+         Error("ERROR: truncated kdcontacts binary atom table") ; }
+
+      atoms[j].atomno = rec.atomno ;
+      atoms[j].resno = rec.resno ;
+      memcpy(atoms[j].atomna, rec.atomna, 4) ;
+      atoms[j].atomna[4] = '\0' ;
+      memcpy(atoms[j].resna, rec.resna, 3) ;
+      atoms[j].resna[3] = '\0' ;
+      memcpy(atoms[j].chainid, rec.chainid, 4) ;
+      atoms[j].chainid[4] = '\0' ;
+      atoms[j].inscode[0] = rec.inscode ;
+      atoms[j].inscode[1] = '\0' ;
+   }
+
+   return atoms ;
+}
+
+
+
+/* decode_contacts: prints every contact record as a kdcontacts text line */
+void decode_contacts( FILE *fp, kdcbin_header_t *header, decodedatom_t *atoms )
+{
+   kdcbin_contact_t *contacts ;
+   size_t numread ;
+   size_t j ;
+
+   contacts = malloc(CONTACTBLOCKSIZE * sizeof(kdcbin_contact_t)) ;
+   if (contacts == NULL) {
+      Error("Out of memory on contacts malloc()\n") ; }
+
+   printf("#resna1\tresno1\tinscode1\tchain_id1\tatomno1\tatomna1\tresna2\tresno2\tinscode2\tchain_id2\tatomno2\tatomna2\tdistance\n") ;
+
+   while ((numread = fread(contacts, sizeof(kdcbin_contact_t), CONTACTBLOCKSIZE, fp)) > 0) {
+      for (j = 0; j < numread; j++) {
+         decodedatom_t *a1, *a2 ;
+
+         if ((contacts[j].atom1 >= header->numatoms) ||
+             (contacts[j].atom2 >= header->numatoms)) {
+            Error("ERROR: contact refers to an atom outside the atom table") ; }
+
+         a1 = &atoms[contacts[j].atom1] ;
+         a2 = &atoms[contacts[j].atom2] ;
+
+         printf("%s\t%d\t%s\t%s\t%d\t%s\t%s\t%d\t%s\t%s\t%d\t%s\t%f\n",
+                a1->resna, a1->resno, a1->inscode, a1->chainid,
+                a1->atomno, a1->atomna,
+                a2->resna, a2->resno, a2->inscode, a2->chainid,
+                a2->atomno, a2->atomna,
+                contacts[j].dist ) ;
+      }
+   }
+
+   free(contacts) ;
+}
@@ -0,0 +1,212 @@
+/* pdb_features.c - Reports the features of a PDB file in one pass
+
+Purpose: does the work of altloc_check and inscode_check, and counts what
+else the pipeline needs to know about a structure, in a single read of it
+Usage: ./pdb_features [pdbfile] > features
+Reads from STDIN if no file is given
+
+Output is one key=value line per feature:
+
+   altloc       1 if an ATOM record has an alternate location indicator
+   inscode      1 if an ATOM record has an insertion code
+   atoms        number of ATOM records
+   residues     number of residues, counting a new one wherever the chain
+                id, residue number or insertion code changes between
+                consecutive ATOM records
+   chains       number of distinct chain ids of ATOM records
+   hetatms      number of HETATM records
+   models       number of MODEL records, 1 if there are none
+   xmin, xmax, ymin, ymax, zmin, zmax
+                coordinate bounds of the ATOM records; only given if there
+                are any
+
+NOTE: - everything but models is taken from the first model, as
+        altloc_check and inscode_check do; altloc and inscode are the
+        numbers those two print
+      - the pdb file may be gzip compressed
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+
+*/
+
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+#include "pdbrecord.h"
+
+
+#define NUMCHAINCODES 256
+#define RESIDLENGTH 6           // chain id, resno and inscode columns
+
+
+//STRUCTURES
+struct features_Struct {
+   int          uses_altloc ;
+   int          uses_inscode ;
+   long         numatoms ;
+   long         numresidues ;
+   int          numchains ;
+   long         numhetatms ;
+   long         nummodels ;
+   float        min[3] ;
+   float        max[3] ;
+} ;
+typedef struct features_Struct features_t ;
+
+
+
+//FUNCTION DECLARATION
+void scanfeatures( pdbreader_t *fp, features_t *features ) ;
+
+void printfeatures( features_t *features ) ;
+
+
+
+int main(int argc, char *argv[])
+{
+   pdbreader_t *fp ;
+   features_t features ;
+
+   if (argc > 1) {
+      fp = pdb_open(argv[1]) ;
+      if (fp == NULL) {
+         fprintf(stderr, "ERROR: PDB file %s does not exist\n", argv[1]) ;
+         exit(1) ;
+      }
+   } else {
+      fp = pdb_fdopen(fileno(stdin), 0) ;
+      if (fp == NULL) {
+         fprintf(stderr, "ERROR: can not read STDIN\n") ;
+         exit(1) ;
+      }
+   }
+
+   scanfeatures(fp, &features) ;
+   if (pdb_error(fp) != NULL) {
+      fprintf(stderr, "ERROR: can not read the PDB file: %s\n", pdb_error(fp)) ;
+      exit(1) ;
+   }
+   pdb_close(fp) ;
+   printfeatures(&features) ;
+
+   return 0;
+}
+
+
+
+/* scanfeatures: reads the whole file once; ATOM and HETATM records past the
+   first ENDMDL only count towards the number of models */
+void scanfeatures( pdbreader_t *fp, features_t *features )
+{
+   const char *line ;
+   int len ;
+
+   int firstmodel = 1 ;
+   char chainseen[NUMCHAINCODES] ;
+   char resid[RESIDLENGTH] ;
+   char resid_last[RESIDLENGTH] ;
+   float coord[3] ;
+   int k ;
+
+   memset(features, 0, sizeof(features_t)) ;
+   memset(chainseen, 0, sizeof(chainseen)) ;
+
+   while (pdb_nextline(fp, &line, &len)) {
+
+      if (firstmodel && pdb_is_atom(line, len)) {
+
+// the same tests as altloc_check and inscode_check; a column missing from a
+// short line reads as blank
+         if (pdb_char(line, len, PDB_ALTLOC) != ' ') {
+            features->uses_altloc = 1 ; }
+         if (pdb_char(line, len, PDB_INSCODE) != ' ') {
+            features->uses_inscode = 1 ; }
+
+         memset(resid, ' ', RESIDLENGTH) ;
+         if (len > PDB_CHAINID) {
+            memcpy(resid, (line + PDB_CHAINID),
+                   ((len - PDB_CHAINID < RESIDLENGTH) ? (len - PDB_CHAINID) : RESIDLENGTH)) ; }
+
+         if ((features->numatoms == 0) ||
+             (memcmp(resid, resid_last, RESIDLENGTH) != 0)) {
+            features->numresidues++ ;
+            memcpy(resid_last, resid, RESIDLENGTH) ;
+         }
+
+         if (! chainseen[(unsigned char) resid[0]]) {
+            chainseen[(unsigned char) resid[0]] = 1 ;
+            features->numchains++ ;
+         }
+
+         coord[0] = pdb_float(line, len, PDB_X) ;
+         coord[1] = pdb_float(line, len, PDB_Y) ;
+         coord[2] = pdb_float(line, len, PDB_Z) ;
+         for (k = 0; k < 3; k++) {
+            if ((features->numatoms == 0) || (coord[k] < features->min[k])) {
+               features->min[k] = coord[k] ; }
+            if ((features->numatoms == 0) || (coord[k] > features->max[k])) {
+               features->max[k] = coord[k] ; }
+         }
+
+         features->numatoms++ ;
+
+      } else if (firstmodel && pdb_is_hetatm(line, len)) {
+
+         features->numhetatms++ ;
+
+      } else if (pdb_is_model(line, len)) {
+
+         features->nummodels++ ;
+
+      } else if (pdb_is_endmdl(line, len)) {
+
+         firstmodel = 0 ;
+
+      }
+   }
+
+   if (features->nummodels == 0) {
+      features->nummodels = 1 ; }
+}
+
+
+
+/* printfeatures: prints the key=value report */
+void printfeatures( features_t *features )
+{
+   printf("altloc=%d\n", features->uses_altloc) ;
+   printf("inscode=%d\n", features->uses_inscode) ;
+   printf("atoms=%ld\n", features->numatoms) ;
+   printf("residues=%ld\n", features->numresidues) ;
+   printf("chains=%d\n", features->numchains) ;
+   printf("hetatms=%ld\n", features->numhetatms) ;
+   printf("models=%ld\n", features->nummodels) ;
+
+   if (features->numatoms > 0) {
+      printf("xmin=%.3f\nxmax=%.3f\n", features->min[0], features->max[0]) ;
+      printf("ymin=%.3f\nymax=%.3f\n", features->min[1], features->max[1]) ;
+      printf("zmin=%.3f\nzmax=%.3f\n", features->min[2], features->max[2]) ;
+   }
+}
@@ -0,0 +1,78 @@
+/* residx.h - Layout of the subset_extractor residue index
+
+Description: written by `subset_extractor --index pdbfile' to pdbfile.ridx
+and read by subset_extractor whenever it is there, so that only the
+residues a subset needs are read from the PDB file.
+
+   residx_header_t             once
+   residx_run_t                header.numruns times, in file order
+
+A run is a stretch of consecutive ATOM lines of the first model that share
+a chain id and residue number (with insertion code); other records may sit
+between its lines. Offsets are in uncompressed bytes from the start of the
+PDB file. The size, inode and modification time (to the nanosecond) of
+the PDB file are kept so that an index left behind by an older file is
+ignored, and subset_extractor checks the residue of every run it seeks to
+against the index as well.
+
+All fields are in the byte order of the machine that wrote the file; an
+index with another byte order is ignored too.
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RESIDX_H
+#define RESIDX_H
+
+#include<stdint.h>
+
+#define RESIDX_MAGIC "RIDX"
+#define RESIDX_VERSION 2
+#define RESIDX_BYTEORDER 0x01020304
+#define RESIDX_SUFFIX ".ridx"
+
+
+struct residx_header_Struct {
+   char         magic[4] ;
+   uint32_t     byteorder ;
+   uint32_t     version ;
+   uint32_t     numruns ;
+   uint64_t     pdbsize ;       // st_size of the PDB file
+   int64_t      pdbmtime ;      // st_mtime of the PDB file
+   int64_t      pdbmtimensec ;  // nanoseconds of st_mtim
+   uint64_t     pdbino ;        // st_ino of the PDB file
+   uint64_t     modelend ;      // offset of the first ENDMDL, or end of file
+} ;
+typedef struct residx_header_Struct residx_header_t ;
+
+
+struct residx_run_Struct {
+   uint64_t     offset ;        // first ATOM line of the run
+   uint32_t     numatoms ;
+   char         resid[6] ;      // columns 22-27 (chain id, resno, inscode)
+                                // of the first line, blank padded
+   char         pad[6] ;
+} ;
+typedef struct residx_run_Struct residx_run_t ;
+
+#endif
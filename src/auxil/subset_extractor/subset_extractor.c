@@ -2,7 +2,28 @@
 
 Purpose: extracts specified residues from a PDB file
 Usage: ./subset_extractor pdbfile < subset definitions
+       ./subset_extractor --manifest manifest pdbfile
+       ./subset_extractor --index pdbfile
+
+Subset definitions are tab-delimited chain id, start and end residue
+numbers, one segment per line; an empty field matches anything. The subset
+is written to STDOUT.
+
+With --manifest, every subset of the structure is written in one pass over
+the PDB file. Manifest lines are tab-delimited subset id, output file and
+the chain id, start and end of one segment; the segments of a subset are
+the lines that carry its id, in order. An output file ending in .gz is
+gzip compressed.
+
+With --index, the residues of pdbfile are indexed into pdbfile.ridx (see
+residx.h) and nothing is extracted. Later runs over pdbfile find the index
+and read only the residues their subsets need; an index left behind by
+another version of the PDB file is ignored.
+
 NOTE: - only uses ^ATOM records
+      - pdbfile may be gzip compressed; an uncompressed one is memory mapped.
+        An index still spares a gzip compressed file the parsing, but not
+        the decompression, of the residues it skips
 
 
 Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
@@ -30,346 +51,1079 @@ along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<zlib.h>
+
+#include "pdbrecord.h"
+#include "residx.h"
 
 
 //#define DEBUG 1
 #define MAXLINELENGTH 81
+#define MAXMANIFESTLINELENGTH 4096
 #define INITNUMSEGS 100
 #define SEGBLOCKSIZE 100
+#define INITNUMSUBSETS 16
+#define INITNUMRESNAMES 1024
+#define NUMCHAINCODES 256
+#define RUNBLOCKSIZE 4096
 #define Error( Str )   fprintf( stderr, "%s\n", Str ), exit( 1 )
 
 
 //STRUCTURES
+/* chain ids are coded as their character and residue numbers (with
+   insertion code) as their id in a resnames_t; code 0 is the empty field,
+   which matches anything */
 struct segment_Struct {
    int		read;
    char		chainid[2] ;
    char		start[6] ;
    char		end[6] ;
+   int		chain ;		// chain code
+   int		start_res ;	// residue ids
+   int		end_res ;
+   int		next ;		// next segment with the same start key, or -1
 } ;
 typedef struct segment_Struct segment_t ;
 
+/* interned residue numbers: every distinct one met in the segments or the
+   PDB file gets the next small integer; id 0 is the empty string */
+struct resnames_Struct {
+   int		number ;
+   int		size ;		// slots, a power of two
+   char		(*names)[6] ;
+   int		*ids ;		// -1 marks an empty slot
+} ;
+typedef struct resnames_Struct resnames_t ;
+
+/* hash of a subset's segments on their start key,
+   start_res * NUMCHAINCODES + chain; each slot heads a list of segments in
+   definition order, from which read ones are dropped as they are met */
+struct segindex_Struct {
+   int		size ;		// slots, a power of two
+   int		*keys ;		// -1 marks an empty slot
+   int		*heads ;
+} ;
+typedef struct segindex_Struct segindex_t ;
+
 struct readinsegments_Struct {
    int		number ;
    int		num_unread ;
+   int		size ;
    segment_t	*details ;
 } ;
 typedef struct readinsegments_Struct readinsegments_t ;
 
+/* a subset being extracted: its segments, where the scan of the PDB file
+   is in them, and where its ATOM lines go */
+struct subset_Struct {
+   char			*subset_id ;	// NULL for STDIN subset definitions
+   char			*out_fn ;
+   FILE			*out_fp ;
+   gzFile		out_gz ;	// NULL unless out_fn ends in .gz
+   readinsegments_t	*segments ;
+   segindex_t		index ;
+
+   int		done ;		// every segment read
+   int		inseg_fl ;
+   int		curseg ;
+   int		lastres_fl ;
+   int		res_last ;
+   int		chain_last ;
+} ;
+typedef struct subset_Struct subset_t ;
+
+struct readinsubsets_Struct {
+   int		number ;
+   int		num_undone ;
+   int		size ;
+   subset_t	*details ;
+} ;
+typedef struct readinsubsets_Struct readinsubsets_t ;
+
+struct residx_Struct {
+   residx_header_t	header ;
+   residx_run_t		*runs ;
+} ;
+typedef struct residx_Struct residx_t ;
+
 
 
 //FUNCTIONS
-readinsegments_t *readinsegments() ;
-void extractsegments( FILE *pdb_fp, readinsegments_t *segments ) ;
-void deblank( char *l ) ;
+readinsegments_t *readinsegments( FILE *fp ) ;
+readinsegments_t *new_segments( void ) ;
+void add_segment( readinsegments_t *segments, char *line_p ) ;
+readinsubsets_t *readinmanifest( char *fn ) ;
+subset_t *new_subset( readinsubsets_t *subsets ) ;
+void open_subset( subset_t *subset ) ;
+void close_subset( subset_t *subset ) ;
+resnames_t *new_resnames( void ) ;
+int intern_resname( resnames_t *resnames, const char *name ) ;
+void index_segments( subset_t *subset, resnames_t *resnames ) ;
+int *segindex_slot( segindex_t *index, int key, int insert ) ;
+int find_segment( subset_t *subset, int chain, int res ) ;
+resnames_t *index_subsets( readinsubsets_t *subsets ) ;
+int extractsegments( pdbreader_t *pdb_fp, readinsubsets_t *subsets ) ;
+int extractsegments_indexed( pdbreader_t *pdb_fp, readinsubsets_t *subsets, residx_t *residx ) ;
+char *residx_filename( char *pdb_fn ) ;
+void write_residx( char *pdb_fn ) ;
+residx_t *read_residx( char *pdb_fn ) ;
+int run_starts_with( residx_run_t *run, const char *line, int len ) ;
+int subset_takes_line( subset_t *subset, int chain, int res ) ;
+void write_subset_line( subset_t *subset, const char *line, int len ) ;
 char *st_sep (char **stringp, const char *delim) ;
 
 
 
 int main(int argc, char *argv[])
 {
-   readinsegments_t *segments ;
+   readinsubsets_t *subsets ;
    char *pdb_fn ;
-   FILE *pdb_fp ;
+   pdbreader_t *pdb_fp ;
+   residx_t *residx ;
+   int alldone ;
+   int i ;
+
+
+   if ((argc == 3) && (strcmp(argv[1], "--index") == 0)) {
+      write_residx(argv[2]) ;
+      return 0 ;
 
+   } else if ((argc == 4) && (strcmp(argv[1], "--manifest") == 0)) {
+      pdb_fn = argv[3] ;
+      subsets = readinmanifest(argv[2]) ;
+
+   } else if ((argc == 2) && (strcmp(argv[1], "--manifest") != 0) &&
+              (strcmp(argv[1], "--index") != 0)) {
+      subset_t *subset ;
 
-   if (argc > 1 ) {
       pdb_fn = argv[1] ;
+      subsets = malloc(sizeof(readinsubsets_t)) ;
+      if (subsets == NULL) {
+         Error("Out of memory on subsets malloc()\n") ; }
+      subsets->number = 0 ;
+      subsets->size = 0 ;
+      subsets->details = NULL ;
+
+      subset = new_subset(subsets) ;
+      subset->segments = readinsegments(stdin) ;
+      subset->out_fp = stdout ;
+
    } else {
-      Error("usage: subset_extractor pdbfile < subset_definition") ;
+      Error("usage: subset_extractor pdbfile < subset_definition\n"
+            "       subset_extractor --manifest manifest pdbfile\n"
+            "       subset_extractor --index pdbfile") ;
    }
 
-   segments = readinsegments() ;
-
 #ifdef DEBUG
-   fprintf(stderr, "read %d segments\n", segments->number) ;
+   fprintf(stderr, "read %d subsets\n", subsets->number) ;
 #endif
 
-   pdb_fp = fopen(pdb_fn, "r") ;
+   pdb_fp = pdb_open(pdb_fn) ;
    if (pdb_fp == NULL) {
       fprintf(stderr, "ERROR: PDB file %s does not exist\n", pdb_fn) ;
       exit(1) ;
    }
-   extractsegments(pdb_fp, segments) ;
-   fclose(pdb_fp) ;
+
+   for (i = 0; i < subsets->number; i++) {
+      open_subset(&subsets->details[i]) ; }
+
+   residx = read_residx(pdb_fn) ;
+   if (residx != NULL) {
+      alldone = extractsegments_indexed(pdb_fp, subsets, residx) ;
+   } else {
+      alldone = extractsegments(pdb_fp, subsets) ; }
+   if (pdb_error(pdb_fp) != NULL) {
+      fprintf(stderr, "ERROR: can not read PDB file %s: %s\n", pdb_fn,
+              pdb_error(pdb_fp)) ;
+      exit(1) ;
+   }
+   pdb_close(pdb_fp) ;
+
+   for (i = 0; i < subsets->number; i++) {
+      close_subset(&subsets->details[i]) ; }
+
+// STDIN subset definitions have always exited 1 once every segment was read
+   if (alldone && (subsets->details[0].subset_id == NULL)) {
+      exit(1) ; }
 
    return 0;
 }
 
 
-readinsegments_t *readinsegments( FILE *pdb_fp )
+/* readinsegments: reads tab-delimited chain id, start, end segment lines */
+readinsegments_t *readinsegments( FILE *fp )
 {
-   int i = 0 ;
    char line[MAXLINELENGTH] ;
-   char *line_p ;
-   char *tempsubstr ;
+   readinsegments_t *results ;
+
+   results = new_segments() ;
+
+   while(fgets(line, sizeof(line), fp)) {
+
+      *(line+(strlen(line)-1)) = '\0' ;
+      add_segment(results, line) ;
+   }
+
+#ifdef DEBUG
+   fprintf(stderr, "num_unread is %d\n", results->num_unread) ;
+#endif
+
+   return results ;
+}
+
 
+/* new_segments: returns an empty segment list */
+readinsegments_t *new_segments( void )
+{
    readinsegments_t *results ;
-   int seglistsize = INITNUMSEGS ;
 
    results = malloc(sizeof(readinsegments_t)) ;
    if (results == NULL ) {
       Error("Out of memory on result malloc()\n") ;
    }
 
-   results->details = malloc(seglistsize * sizeof(segment_t)) ;
+   results->number = 0 ;
+   results->num_unread = 0 ;
+   results->size = INITNUMSEGS ;
+   results->details = malloc(results->size * sizeof(segment_t)) ;
    if (results->details == NULL) {
       Error("Out of memory on details malloc()\n") ;
    }
 
-   i = 0 ;
-   while(fgets(line, sizeof(line), stdin)) {
+   return results ;
+}
 
-      *(line+(strlen(line)-1)) = '\0' ;
-      line_p = line ;
 
-      if( i >= seglistsize) {
-         segment_t *newp;
-	 seglistsize += SEGBLOCKSIZE ;
-	 newp = realloc(results->details, seglistsize * sizeof(segment_t)) ;
+/* add_segment: parses a chain id, start, end segment and appends it */
+void add_segment( readinsegments_t *segments, char *line_p )
+{
+   segment_t *seg ;
+   char *tempsubstr ;
 
-         if (newp == NULL) {
-	    Error("Out of Memmory on realloc()\n") ;
-         }
+   if (segments->number >= segments->size) {
+      segment_t *newp;
+      segments->size += SEGBLOCKSIZE ;
+      newp = realloc(segments->details, segments->size * sizeof(segment_t)) ;
 
-         results->details = newp ;
+      if (newp == NULL) {
+         Error("Out of Memmory on realloc()\n") ;
       }
 
-      tempsubstr = st_sep(&line_p, "\t") ;
-      strcpy(results->details[i].chainid, tempsubstr) ;
+      segments->details = newp ;
+   }
+
+   seg = &segments->details[segments->number] ;
 
-      tempsubstr = st_sep(&line_p, "\t") ;
-      strcpy(results->details[i].start, tempsubstr) ;
-      tempsubstr = st_sep(&line_p, "\n") ;
-      strcpy(results->details[i].end, tempsubstr) ;
+   tempsubstr = st_sep(&line_p, "\t") ;
+   if ((tempsubstr == NULL) || (strlen(tempsubstr) >= sizeof(seg->chainid))) {
+      Error("ERROR: bad chain id in segment definition") ; }
+   strcpy(seg->chainid, tempsubstr) ;
+
+   tempsubstr = st_sep(&line_p, "\t") ;
+   if ((tempsubstr == NULL) || (strlen(tempsubstr) >= sizeof(seg->start))) {
+      Error("ERROR: bad start residue in segment definition") ; }
+   strcpy(seg->start, tempsubstr) ;
+
+   tempsubstr = st_sep(&line_p, "\n") ;
+   if ((tempsubstr == NULL) || (strlen(tempsubstr) >= sizeof(seg->end))) {
+      Error("ERROR: bad end residue in segment definition") ; }
+   strcpy(seg->end, tempsubstr) ;
 
 #ifdef DEBUG
-      fprintf(stderr, "segment %d: chain %s, start %s, end %s\n", i,
-		      results->details[i].chainid,
-		      results->details[i].start,
-		      results->details[i].end) ;
+   fprintf(stderr, "segment %d: chain %s, start %s, end %s\n", segments->number,
+                   seg->chainid, seg->start, seg->end) ;
 #endif
 
-      results->details[i].read = 0 ;
-      i++ ;
+   seg->read = 0 ;
+   segments->number++ ;
+   segments->num_unread++ ;
+}
+
+
+/* readinmanifest: reads subset id, output file, chain id, start, end lines
+   into one subset per subset id */
+readinsubsets_t *readinmanifest( char *fn )
+{
+   char line[MAXMANIFESTLINELENGTH] ;
+   readinsubsets_t *results ;
+   FILE *fp ;
+
+   fp = fopen(fn, "r") ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: manifest file %s does not exist\n", fn) ;
+      exit(1) ;
    }
 
-   results->number = i ;
-   results->num_unread = i ;
+   results = malloc(sizeof(readinsubsets_t)) ;
+   if (results == NULL) {
+      Error("Out of memory on subsets malloc()\n") ; }
+   results->number = 0 ;
+   results->size = 0 ;
+   results->details = NULL ;
+
+   while (fgets(line, sizeof(line), fp)) {
+      char *line_p = line ;
+      char *subset_id, *out_fn ;
+      subset_t *subset = NULL ;
+      int i ;
+
+      line[strcspn(line, "\r\n")] = '\0' ;
+      if ((line[0] == '\0') || (line[0] == '#')) {
+         continue ; }
+
+      subset_id = st_sep(&line_p, "\t") ;
+      out_fn = st_sep(&line_p, "\t") ;
+      if ((out_fn == NULL) || (line_p == NULL) || (out_fn[0] == '\0')) {
+         fprintf(stderr, "ERROR: bad manifest line for subset %s\n", subset_id) ;
+         exit(1) ;
+      }
 
-#ifdef DEBUG
-   fprintf(stderr, "num_unread is %d\n", results->num_unread) ;
-#endif
+      for (i = results->number - 1; i >= 0; i--) {
+         if (strcmp(results->details[i].subset_id, subset_id) == 0) {
+            subset = &results->details[i] ;
+            break ;
+         }
+      }
+
+      if (subset == NULL) {
+         subset = new_subset(results) ;
+         subset->subset_id = strdup(subset_id) ;
+         subset->out_fn = strdup(out_fn) ;
+         subset->segments = new_segments() ;
+         if ((subset->subset_id == NULL) || (subset->out_fn == NULL)) {
+            Error("Out of memory on subset strdup()\n") ; }
+
+      } else if (strcmp(subset->out_fn, out_fn) != 0) {
+         fprintf(stderr, "ERROR: subset %s is given two output files\n", subset_id) ;
+         exit(1) ;
+      }
+
+      add_segment(subset->segments, line_p) ;
+   }
+
+   fclose(fp) ;
 
    return results ;
 }
 
 
-void extractsegments( FILE *pdb_fp, readinsegments_t *segments )
+/* new_subset: appends a subset with no segments and no output */
+subset_t *new_subset( readinsubsets_t *subsets )
 {
-   char line[MAXLINELENGTH] ;
+   subset_t *subset ;
+
+   if (subsets->number >= subsets->size) {
+      subset_t *newp ;
+      subsets->size = (subsets->size == 0) ? INITNUMSUBSETS : (2 * subsets->size) ;
+      newp = realloc(subsets->details, subsets->size * sizeof(subset_t)) ;
+      if (newp == NULL) {
+         Error("Out of Memmory on realloc()\n") ; }
+      subsets->details = newp ;
+   }
+
+   subset = &subsets->details[subsets->number++] ;
+   subset->subset_id = NULL ;
+   subset->out_fn = NULL ;
+   subset->out_fp = NULL ;
+   subset->out_gz = NULL ;
+   subset->segments = NULL ;
+   subset->done = 0 ;
+   subset->inseg_fl = 0 ;
+   subset->curseg = -1 ;
+   subset->lastres_fl = 0 ;
+   subset->res_last = -1 ;
+   subset->chain_last = -1 ;
+   subset->index.size = 0 ;
+   subset->index.keys = NULL ;
+   subset->index.heads = NULL ;
+
+   return subset ;
+}
+
+
+/* open_subset: creates the output file of a manifest subset, gzip
+   compressed if its name ends in .gz */
+void open_subset( subset_t *subset )
+{
+   size_t len ;
+
+   if (subset->out_fp != NULL) {
+      return ; }
+
+   len = strlen(subset->out_fn) ;
+   if ((len > 3) && (strcmp(subset->out_fn + len - 3, ".gz") == 0)) {
+      subset->out_gz = gzopen(subset->out_fn, "wb") ;
+   } else {
+      subset->out_fp = fopen(subset->out_fn, "w") ;
+   }
+
+   if ((subset->out_fp == NULL) && (subset->out_gz == NULL)) {
+      fprintf(stderr, "ERROR: can not write subset %s to %s\n",
+              subset->subset_id, subset->out_fn) ;
+      exit(1) ;
+   }
+}
+
+
+/* close_subset: flushes and closes the output of a subset */
+void close_subset( subset_t *subset )
+{
+   int status = 0 ;
+
+   if (subset->out_gz != NULL) {
+      status = (gzclose(subset->out_gz) != Z_OK) ;
+   } else if (subset->out_fp == stdout) {
+      status = (fflush(stdout) != 0) ;
+   } else {
+      status = (fclose(subset->out_fp) != 0) ;
+   }
+
+   if (status) {
+      fprintf(stderr, "ERROR: failed writing subset %s to %s\n",
+              (subset->subset_id != NULL) ? subset->subset_id : "",
+              (subset->out_fn != NULL) ? subset->out_fn : "STDOUT") ;
+      exit(1) ;
+   }
+}
+
+
+/* extractsegments: runs every ATOM line of the first model past every
+   subset that is not done yet; returns 1 if every subset was done before
+   the end of the model */
+int extractsegments( pdbreader_t *pdb_fp, readinsubsets_t *subsets )
+{
+   const char *line ;
+   int len ;
 
    int j  = 1;
 
    char chainid[2] ;
    char resno_full[6] ;
+   char resno_prev[6] = "" ;
+   resnames_t *resnames ;
+   int chain ;
+   int res = 0 ;
+   int k ;
 
-   int inseg_fl = 0 ;
-   int curseg = -1 ;
-   int lastres_fl = 0 ;
+   resnames = index_subsets(subsets) ;
+   subsets->num_undone = subsets->number ;
 
-   char resno_last[6] ;
-   char chainid_last[2] ;
+   while (j && pdb_nextline(pdb_fp, &line, &len)) {
 
+      if (pdb_is_atom(line, len)) {
 
-   while ((fgets(line, sizeof(line), pdb_fp)) && j ) {
+         pdb_copy_trimmed(line, len, PDB_CHAINID, 1, chainid) ;
+         pdb_copy_trimmed(line, len, PDB_RESNO_FULL, resno_full) ;
 
-      *(line+(strlen(line))) = '\0';
+// the atoms of a residue come together, so most lines reuse the last id
+         chain = (unsigned char) chainid[0] ;
+         if (strcmp(resno_full, resno_prev) != 0) {
+            res = intern_resname(resnames, resno_full) ;
+            strcpy(resno_prev, resno_full) ;
+         }
 
-// fpd080611_2014 added this line to fix extra blank lines when extracting
-//   subsets from PQS files which have ATOM records less than full 81 char
-      if (line[strlen(line) - 1] == '\n') {
-         *(line+(strlen(line) - 1)) = '\0'; }
+         for (k = 0; k < subsets->number; k++) {
+            subset_t *subset = &subsets->details[k] ;
 
-      if ((line[0] == 'A') &&
-          (line[1] == 'T') &&
-          (line[2] == 'O') &&
-          (line[3] == 'M')) {
+            if (subset->done) {
+               continue ; }
 
+            if (subset_takes_line(subset, chain, res)) {
+               write_subset_line(subset, line, len) ;
 
-         strncpy(chainid, (line + 21), 1) ;
-         chainid[1] = '\0' ;
-      
-         strncpy(resno_full, (line + 22), 5) ;
-         *(resno_full+(5)) = '\0' ;
+            } else if (subset->done) {
+               subsets->num_undone-- ;
+               if (subsets->num_undone == 0) {
+                  return 1 ; }
+            }
+         }
 
-	 deblank(resno_full) ;
-	 deblank(chainid) ;
+	 j = 1 ;
 
-	 if ( lastres_fl &&
-	      ((strcmp(resno_full, resno_last) != 0) ||
-               (strcmp(chainid, chainid_last) != 0))) {
+      } else if (pdb_is_endmdl(line, len)) {
 
-	    lastres_fl = 0 ;
-	    inseg_fl = 0 ;
-	    segments->details[curseg].read = 1 ;
-	    segments->num_unread-- ;
+         j = 0;
 
-	    if (segments->num_unread == 0 ) {
-	       exit(1) ;
-	    }
+      }
 
-	 }
+   }
 
-	 if (inseg_fl) {
-	    int chain_nullfl = 0 ;
-	    int end_nullfl = 0 ;
+   return 0 ;
+}
 
-	    int chain_match = 0 ;
-	    int end_match = 0 ;
 
-	    if ( strcmp(segments->details[curseg].end, "") == 0  ) {
-	       end_nullfl = 1 ; 
-	    }
+/* extractsegments_indexed: does what extractsegments() does, a residue run
+   at a time from the index of the PDB file; the lines of a run are only
+   read if some subset takes it */
+int extractsegments_indexed( pdbreader_t *pdb_fp, readinsubsets_t *subsets, residx_t *residx )
+{
+   const char *line ;
+   int len ;
 
-	    if ( strcmp(segments->details[curseg].chainid, "") == 0 ) {
-	       chain_nullfl = 1 ; 
-	    }
+   char chainid[2] ;
+   char resno_full[6] ;
+   resnames_t *resnames ;
+   subset_t **takers ;
+   int numtakers ;
+   int chain ;
+   int res ;
+   unsigned int r ;
+   int k ;
+
+   resnames = index_subsets(subsets) ;
+   subsets->num_undone = subsets->number ;
+
+   takers = malloc(subsets->number * sizeof(subset_t *)) ;
+   if (takers == NULL) {
+      Error("Out of memory on takers malloc()\n") ; }
+
+   for (r = 0; r < residx->header.numruns; r++) {
+      residx_run_t *run = &residx->runs[r] ;
+      long long end = (r + 1 < residx->header.numruns) ?
+                      (long long) residx->runs[r + 1].offset :
+                      (long long) residx->header.modelend ;
+
+// resid holds PDB columns 22-27: the chain id, then resno and inscode
+      pdb_copy_trimmed(run->resid, sizeof(run->resid), 0, 1, chainid) ;
+      pdb_copy_trimmed(run->resid, sizeof(run->resid), 1, 5, resno_full) ;
+      chain = (unsigned char) chainid[0] ;
+      res = intern_resname(resnames, resno_full) ;
+
+      numtakers = 0 ;
+      for (k = 0; k < subsets->number; k++) {
+         subset_t *subset = &subsets->details[k] ;
+         int taken ;
+
+         if (subset->done) {
+            continue ; }
+
+// the second line of a run can still close a segment that ends on the
+// residue it started on; later lines leave the scan where it is
+         taken = subset_takes_line(subset, chain, res) ;
+         if ((run->numatoms > 1) && (! subset->done)) {
+            taken = subset_takes_line(subset, chain, res) ; }
+
+         if (taken) {
+            takers[numtakers++] = subset ;
+
+         } else if (subset->done) {
+            subsets->num_undone-- ;
+            if (subsets->num_undone == 0) {
+               free(takers) ;
+               return 1 ;
+            }
+         }
+      }
 
-	    if (strcmp(resno_full, segments->details[curseg].end) == 0) {
-	       end_match = 1 ;
-	    }
+      if (numtakers == 0) {
+         continue ; }
 
-	    if (strcmp(chainid, segments->details[curseg].chainid) == 0) {
-	       chain_match = 1 ;
-	    }
+// a file rewritten within the same size and time is caught by the first
+// line of the run not being the residue the index has there
+      if ((! pdb_seek(pdb_fp, run->offset)) ||
+          (! pdb_nextline(pdb_fp, &line, &len)) ||
+          (! pdb_is_atom(line, len)) ||
+          (! run_starts_with(run, line, len))) {
+         Error("ERROR: PDB file does not match its residue index") ; }
 
-	    if ((end_nullfl) && (! chain_nullfl) && (! chain_match)) {
-//               fprintf(stderr, " set out of inseg_fl\n") ;
-	       inseg_fl = 0 ;
-	    } else if ((chain_nullfl) && (! end_nullfl) && (end_match)) {
-               lastres_fl = 1 ;
-	    } else if ((!chain_nullfl) && (!end_nullfl) &&
-	               (chain_match) && (end_match) ) {
-               lastres_fl = 1 ;
-	    }
+      do {
+         if (pdb_is_atom(line, len)) {
+            for (k = 0; k < numtakers; k++) {
+               write_subset_line(takers[k], line, len) ; }
+         }
+      } while ((pdb_tell(pdb_fp) < end) && pdb_nextline(pdb_fp, &line, &len)) ;
+   }
+
+   free(takers) ;
+   return 0 ;
+}
+
+
+/* index_subsets: sets up the segment indexes of every subset; returns the
+   table their residue numbers were interned into */
+resnames_t *index_subsets( readinsubsets_t *subsets )
+{
+   resnames_t *resnames ;
+   int k ;
+
+   resnames = new_resnames() ;
+   for (k = 0; k < subsets->number; k++) {
+      index_segments(&subsets->details[k], resnames) ; }
+
+   return resnames ;
+}
+
+
+/* subset_takes_line: moves a subset's segment scan on by one ATOM line, of
+   chain code chain and residue id res, and tells if the line is in one of
+   its segments; sets subset->done once the line after the last residue of
+   its last unread segment is met */
+int subset_takes_line( subset_t *subset, int chain, int res )
+{
+   readinsegments_t *segments = subset->segments ;
 
-//if lastres_fl, need to delete the current segment out of the segment list
-// or just set a flag that the segment has been read alreaxdy
+   if ( subset->lastres_fl &&
+        ((res != subset->res_last) || (chain != subset->chain_last))) {
 
-	    strcpy(resno_last, resno_full) ;
-	    strcpy(chainid_last, chainid) ;
+      subset->lastres_fl = 0 ;
+      subset->inseg_fl = 0 ;
+      segments->details[subset->curseg].read = 1 ;
+      segments->num_unread-- ;
+
+      if (segments->num_unread == 0 ) {
+         subset->done = 1 ;
+         return 0 ;
+      }
+
+   }
+
+   if (subset->inseg_fl) {
+      segment_t *seg = &segments->details[subset->curseg] ;
+      int chain_nullfl = (seg->chain == 0) ;
+      int end_nullfl = (seg->end_res == 0) ;
+      int chain_match = (chain == seg->chain) ;
+      int end_match = (res == seg->end_res) ;
+
+      if ((end_nullfl) && (! chain_nullfl) && (! chain_match)) {
+         subset->inseg_fl = 0 ;
+      } else if ((chain_nullfl) && (! end_nullfl) && (end_match)) {
+         subset->lastres_fl = 1 ;
+      } else if ((!chain_nullfl) && (!end_nullfl) &&
+                 (chain_match) && (end_match) ) {
+         subset->lastres_fl = 1 ;
+      }
+
+//if lastres_fl, the segment is flagged as read once its last residue is left
+      subset->res_last = res ;
+      subset->chain_last = chain ;
 
 #ifdef DEBUG
-	       fprintf(stderr, "in segment\n") ;
+      fprintf(stderr, "in segment\n") ;
 #endif
 
-	 }
-
-	 if (! inseg_fl) {
+   }
 
-	    int k ; 
-	    for (k = 0; k < segments->number; k++) {
+   if (! subset->inseg_fl) {
+      int k = find_segment(subset, chain, res) ;
 
-	       if (!segments->details[k].read) {
+      if (k >= 0) {
+         subset->inseg_fl = 1 ;
+         subset->curseg = k ;
+      }
+   }
 
-	          int chain_nullfl = 0 ;
-		  int start_nullfl = 0 ;
+   return subset->inseg_fl ;
+}
 
-	          int chain_match = 0 ;
-		  int start_match = 0 ;
 
-	          if ( strcmp(segments->details[k].start, "") == 0 ) {
-	             start_nullfl = 1 ;
-                  }
+/* find_segment: returns the first unread segment, in definition order,
+   that starts at residue res of chain code chain, or -1. A segment starts
+   there if its start and chain each match or are empty, so the four start
+   keys (res, chain), (res, any), (any, chain) and (any, any) are looked up */
+int find_segment( subset_t *subset, int chain, int res )
+{
+   segment_t *seg = subset->segments->details ;
+   int keys[4] ;
+   int best = -1 ;
+   int q ;
 
-	          if ( strcmp(segments->details[k].chainid, "") == 0 ) {
-	             chain_nullfl = 1 ; 
-	          }
+   keys[0] = res * NUMCHAINCODES + chain ;
+   keys[1] = res * NUMCHAINCODES ;
+   keys[2] = chain ;
+   keys[3] = 0 ;
 
+   for (q = 0; q < 4; q++) {
+      int *head = segindex_slot(&subset->index, keys[q], 0) ;
 
-	          if ((chain_nullfl) && (start_nullfl)) {
-	             inseg_fl = 1 ;
-		     curseg = k ;
-		     break ;
-	          }
+      if (head == NULL) {
+         continue ; }
 
-	          if ((strcmp(resno_full, segments->details[k].start) == 0) ||
-	              (start_nullfl)) {
-	             start_match = 1 ;
-	          }
+      while ((*head >= 0) && seg[*head].read) {
+         *head = seg[*head].next ; }
 
-	          if ((strcmp(chainid, segments->details[k].chainid) == 0) ||
-	              (chain_nullfl)) {
-	             chain_match = 1 ;
-	          }
+      if ((*head >= 0) && ((best < 0) || (*head < best))) {
+         best = *head ; }
+   }
 
 #ifdef DEBUG
-                  fprintf(stdout, "comparing %s on chain %s to segment res %s on chain %s (res match %d, chain match %d)\n", resno_full, chainid, segments->details[k].start, segments->details[k].chainid, start_match, chain_match) ;
+   fprintf(stderr, "residue %d on chain %d starts segment %d\n", res, chain, best) ;
 #endif
 
+   return best ;
+}
 
-	          if ( (start_match) && (chain_match) ) {
-	             inseg_fl = 1 ;
-		     curseg = k ;
-		     break ;
-	          }
 
-	       }
+/* new_resnames: returns an interning table holding only the empty string */
+resnames_t *new_resnames( void )
+{
+   resnames_t *resnames ;
+   int j ;
 
-	    }
+   resnames = malloc(sizeof(resnames_t)) ;
+   if (resnames == NULL) {
+      Error("Out of memory on resnames malloc()\n") ; }
 
-	 }
+   resnames->number = 0 ;
+   resnames->size = INITNUMRESNAMES ;
+   resnames->names = malloc(resnames->size * sizeof(*resnames->names)) ;
+   resnames->ids = malloc(resnames->size * sizeof(int)) ;
+   if ((resnames->names == NULL) || (resnames->ids == NULL)) {
+      Error("Out of memory on resnames malloc()\n") ; }
 
-	 if (inseg_fl) {
-	    printf("%s\n",line) ;
-	 }
+   for (j = 0; j < resnames->size; j++) {
+      resnames->ids[j] = -1 ; }
 
-	 j = 1 ;
+   intern_resname(resnames, "") ;
 
-      } else if ( (line[0] == 'E') &&
-                  (line[1] == 'N') &&
-                  (line[2] == 'D') &&
-                  (line[3] == 'M') &&
-                  (line[4] == 'D') &&
-                  (line[5] == 'L') ) {
+   return resnames ;
+}
 
-	 inseg_fl = 0 ;
-         j = 0;
 
+/* intern_resname: returns the id of a residue number, giving it the next
+   one if it is new */
+int intern_resname( resnames_t *resnames, const char *name )
+{
+   unsigned int hash = 2166136261u ;
+   const char *c ;
+   int slot ;
+
+   for (c = name; *c != '\0'; c++) {
+      hash = (hash ^ (unsigned char) *c) * 16777619u ; }
+
+   slot = hash & (resnames->size - 1) ;
+   while (resnames->ids[slot] >= 0) {
+      if (strcmp(resnames->names[slot], name) == 0) {
+         return resnames->ids[slot] ; }
+      slot = (slot + 1) & (resnames->size - 1) ;
+   }
+
+   strcpy(resnames->names[slot], name) ;
+   resnames->ids[slot] = resnames->number++ ;
+
+   if (2 * resnames->number > resnames->size) {
+      char (*oldnames)[6] = resnames->names ;
+      int *oldids = resnames->ids ;
+      int oldsize = resnames->size ;
+      int id = resnames->ids[slot] ;
+      int j ;
+
+      resnames->size *= 2 ;
+      resnames->names = malloc(resnames->size * sizeof(*resnames->names)) ;
+      resnames->ids = malloc(resnames->size * sizeof(int)) ;
+      if ((resnames->names == NULL) || (resnames->ids == NULL)) {
+         Error("Out of memory on resnames malloc()\n") ; }
+
+      for (j = 0; j < resnames->size; j++) {
+         resnames->ids[j] = -1 ; }
+
+      for (j = 0; j < oldsize; j++) {
+         unsigned int h = 2166136261u ;
+         int s2 ;
+
+         if (oldids[j] < 0) {
+            continue ; }
+
+         for (c = oldnames[j]; *c != '\0'; c++) {
+            h = (h ^ (unsigned char) *c) * 16777619u ; }
+
+         s2 = h & (resnames->size - 1) ;
+         while (resnames->ids[s2] >= 0) {
+            s2 = (s2 + 1) & (resnames->size - 1) ; }
+         strcpy(resnames->names[s2], oldnames[j]) ;
+         resnames->ids[s2] = oldids[j] ;
       }
 
+      free(oldnames) ;
+      free(oldids) ;
+      return id ;
+   }
+
+   return resnames->ids[slot] ;
+}
+
+
+/* index_segments: codes the chains and interns the residue numbers of a
+   subset's segments and hashes them on their start keys */
+void index_segments( subset_t *subset, resnames_t *resnames )
+{
+   readinsegments_t *segments = subset->segments ;
+   int k ;
+
+   subset->index.size = 16 ;
+   while (subset->index.size < 2 * segments->number) {
+      subset->index.size *= 2 ; }
+
+   subset->index.keys = malloc(subset->index.size * sizeof(int)) ;
+   subset->index.heads = malloc(subset->index.size * sizeof(int)) ;
+   if ((subset->index.keys == NULL) || (subset->index.heads == NULL)) {
+      Error("Out of memory on segment index malloc()\n") ; }
+
+   for (k = 0; k < subset->index.size; k++) {
+      subset->index.keys[k] = -1 ; }
+
+// walked backwards so that every list ends up in definition order
+   for (k = segments->number - 1; k >= 0; k--) {
+      segment_t *seg = &segments->details[k] ;
+      int *head ;
+
+      seg->chain = (unsigned char) seg->chainid[0] ;
+      seg->start_res = intern_resname(resnames, seg->start) ;
+      seg->end_res = intern_resname(resnames, seg->end) ;
+
+      head = segindex_slot(&subset->index,
+                           (seg->start_res * NUMCHAINCODES + seg->chain), 1) ;
+      seg->next = *head ;
+      *head = k ;
+   }
+}
+
+
+/* segindex_slot: returns the list head of a start key, or NULL if the key
+   has no segments; with insert set, a missing key gets an empty list */
+int *segindex_slot( segindex_t *index, int key, int insert )
+{
+   int slot = ((unsigned int) key * 2654435761u) & (index->size - 1) ;
+
+   while (index->keys[slot] >= 0) {
+      if (index->keys[slot] == key) {
+         return &index->heads[slot] ; }
+      slot = (slot + 1) & (index->size - 1) ;
    }
 
+   if (! insert) {
+      return NULL ; }
+
+   index->keys[slot] = key ;
+   index->heads[slot] = -1 ;
+   return &index->heads[slot] ;
 }
 
 
-// FROM: http://www.harpercollege.edu/bus-ss/cis/166/mmckenzi/samples/lect10c.c
-/* strip leading, trailing and double spaces */
-void deblank( char *l )
+/* residx_filename: returns the name of the residue index of a PDB file */
+char *residx_filename( char *pdb_fn )
 {
-   int i;
-   char *p;
-
-   i = strspn( l, " " ); /* find 1st non-blank */
-   if ( i > 0 ) {
-      for( p = l; ; p++ ) {
-	 *p = *(p+i);
-         if (*p == '\0') break;
+   char *idx_fn ;
+
+   idx_fn = malloc(strlen(pdb_fn) + strlen(RESIDX_SUFFIX) + 1) ;
+   if (idx_fn == NULL) {
+      Error("Out of memory on index filename malloc()\n") ; }
+
+   strcpy(idx_fn, pdb_fn) ;
+   strcat(idx_fn, RESIDX_SUFFIX) ;
+
+   return idx_fn ;
+}
+
+
+/* write_residx: records where every residue run of the first model of a
+   PDB file starts, in pdbfile.ridx */
+void write_residx( char *pdb_fn )
+{
+   pdbreader_t *pdb_fp ;
+   struct stat st ;
+   residx_header_t header ;
+   residx_run_t *runs ;
+   unsigned int size ;
+   char *idx_fn ;
+   FILE *idx_fp ;
+
+   const char *line ;
+   int len ;
+   long long offset ;
+
+   char chainid[2] ;
+   char resno_full[6] ;
+   char chainid_prev[2] = "" ;
+   char resno_prev[6] = "" ;
+
+   pdb_fp = pdb_open(pdb_fn) ;
+   if ((pdb_fp == NULL) || (stat(pdb_fn, &st) != 0)) {
+      fprintf(stderr, "ERROR: PDB file %s does not exist\n", pdb_fn) ;
+      exit(1) ;
+   }
+
+   memset(&header, 0, sizeof(header)) ;
+   memcpy(header.magic, RESIDX_MAGIC, 4) ;
+   header.byteorder = RESIDX_BYTEORDER ;
+   header.version = RESIDX_VERSION ;
+   header.pdbsize = st.st_size ;
+   header.pdbmtime = st.st_mtime ;
+   header.pdbmtimensec = st.st_mtim.tv_nsec ;
+   header.pdbino = st.st_ino ;
+
+   size = RUNBLOCKSIZE ;
+   runs = malloc(size * sizeof(residx_run_t)) ;
+   if (runs == NULL) {
+      Error("Out of memory on runs malloc()\n") ; }
+
+   offset = pdb_tell(pdb_fp) ;
+   while (pdb_nextline(pdb_fp, &line, &len)) {
+
+      if (pdb_is_atom(line, len)) {
+
+         pdb_copy_trimmed(line, len, PDB_CHAINID, 1, chainid) ;
+         pdb_copy_trimmed(line, len, PDB_RESNO_FULL, resno_full) ;
+
+         if ((header.numruns == 0) || (strcmp(chainid, chainid_prev) != 0) ||
+             (strcmp(resno_full, resno_prev) != 0)) {
+            residx_run_t *run ;
+            int n = len - PDB_CHAINID ;
+
+            if (header.numruns >= size) {
+               residx_run_t *newp ;
+               size *= 2 ;
+               newp = realloc(runs, size * sizeof(residx_run_t)) ;
+               if (newp == NULL) {
+                  Error("Out of memory on runs realloc()\n") ; }
+               runs = newp ;
+            }
+
+            run = &runs[header.numruns++] ;
+            memset(run, 0, sizeof(residx_run_t)) ;
+            run->offset = offset ;
+            memset(run->resid, ' ', sizeof(run->resid)) ;
+            if (n > (int) sizeof(run->resid)) {
+               n = sizeof(run->resid) ; }
+            if (n > 0) {
+               memcpy(run->resid, (line + PDB_CHAINID), n) ; }
+
+            strcpy(chainid_prev, chainid) ;
+            strcpy(resno_prev, resno_full) ;
+         }
+
+         runs[header.numruns - 1].numatoms++ ;
+
+      } else if (pdb_is_endmdl(line, len)) {
+
+         break ;
+
       }
+
+      offset = pdb_tell(pdb_fp) ;
    }
 
-   while( (p = strstr( l, "  ") ) != NULL ) {
-      i = strspn( p, " "); /* find length of blank prefix */
-      do {
-         ++p;
-         *p = *(p+i-1);
-      } while( *p );
+   header.modelend = offset ;
+   if (pdb_error(pdb_fp) != NULL) {
+      fprintf(stderr, "ERROR: can not read PDB file %s: %s\n", pdb_fn,
+              pdb_error(pdb_fp)) ;
+      exit(1) ;
    }
+   pdb_close(pdb_fp) ;
 
-   if ( ( i = strlen( l ) - 1 ) >= 0 ) {
-      l[i] = ( l[i] == ' ' ) ? '\0' : l[i]; /* make trailing space a null */
+   idx_fn = residx_filename(pdb_fn) ;
+   idx_fp = fopen(idx_fn, "wb") ;
+   if (idx_fp == NULL) {
+      fprintf(stderr, "ERROR: can not write residue index %s\n", idx_fn) ;
+      exit(1) ;
+   }
+
+   if ((fwrite(&header, sizeof(header), 1, idx_fp) != 1) ||
+       (fwrite(runs, sizeof(residx_run_t), header.numruns, idx_fp) != header.numruns) ||
+       (fclose(idx_fp) != 0)) {
+      fprintf(stderr, "ERROR: can not write residue index %s\n", idx_fn) ;
+      exit(1) ;
+   }
+
+#ifdef DEBUG
+   fprintf(stderr, "indexed %u residue runs\n", header.numruns) ;
+#endif
+
+   free(runs) ;
+   free(idx_fn) ;
+}
+
+
+/* read_residx: reads in the residue index of a PDB file; returns NULL if
+   there is none, or if it does not fit the PDB file as it is now */
+residx_t *read_residx( char *pdb_fn )
+{
+   struct stat st ;
+   residx_t *residx ;
+   char *idx_fn ;
+   FILE *idx_fp ;
+
+   if (stat(pdb_fn, &st) != 0) {
+      return NULL ; }
+
+   idx_fn = residx_filename(pdb_fn) ;
+   idx_fp = fopen(idx_fn, "rb") ;
+   free(idx_fn) ;
+   if (idx_fp == NULL) {
+      return NULL ; }
+
+   residx = malloc(sizeof(residx_t)) ;
+   if (residx == NULL) {
+      Error("Out of memory on residx malloc()\n") ; }
+   residx->runs = NULL ;
+
+   if ((fread(&residx->header, sizeof(residx_header_t), 1, idx_fp) != 1) ||
+       (memcmp(residx->header.magic, RESIDX_MAGIC, 4) != 0) ||
+       (residx->header.byteorder != RESIDX_BYTEORDER) ||
+       (residx->header.version != RESIDX_VERSION) ||
+       (residx->header.pdbsize != (uint64_t) st.st_size) ||
+       (residx->header.pdbmtime != (int64_t) st.st_mtime) ||
+       (residx->header.pdbmtimensec != (int64_t) st.st_mtim.tv_nsec) ||
+       (residx->header.pdbino != (uint64_t) st.st_ino)) {
+      fclose(idx_fp) ;
+      free(residx) ;
+      return NULL ;
+   }
+
+   residx->runs = malloc((residx->header.numruns > 0 ? residx->header.numruns : 1) *
+                         sizeof(residx_run_t)) ;
+   if (residx->runs == NULL) {
+      Error("Out of memory on runs malloc()\n") ; }
+
+   if (fread(residx->runs, sizeof(residx_run_t), residx->header.numruns, idx_fp) !=
+       residx->header.numruns) {
+      fclose(idx_fp) ;
+      free(residx->runs) ;
+      free(residx) ;
+      return NULL ;
+   }
+
+   fclose(idx_fp) ;
+
+#ifdef DEBUG
+   fprintf(stderr, "read %u residue runs from the index\n", residx->header.numruns) ;
+#endif
+
+   return residx ;
+}
+
+
+/* run_starts_with: true if an ATOM line has the residue id (columns 22-27,
+   blank padded) the index gives its run */
+int run_starts_with( residx_run_t *run, const char *line, int len )
+{
+   char resid[sizeof(run->resid)] ;
+   int n = len - PDB_CHAINID ;
+
+   memset(resid, ' ', sizeof(resid)) ;
+   if (n > (int) sizeof(resid)) {
+      n = sizeof(resid) ; }
+   if (n > 0) {
+      memcpy(resid, (line + PDB_CHAINID), n) ; }
+
+   return (memcmp(resid, run->resid, sizeof(resid)) == 0) ;
+}
+
+
+/* write_subset_line: writes an ATOM line to the output of a subset */
+void write_subset_line( subset_t *subset, const char *line, int len )
+{
+   if (subset->out_gz != NULL) {
+      if ((gzwrite(subset->out_gz, line, len) != len) ||
+          (gzputc(subset->out_gz, '\n') != '\n')) {
+         fprintf(stderr, "ERROR: failed writing subset %s to %s\n",
+                 subset->subset_id, subset->out_fn) ;
+         exit(1) ;
+      }
+      return ;
    }
 
+   fwrite(line, 1, len, subset->out_fp) ;
+   putc('\n', subset->out_fp) ;
 }
 
 
@@ -0,0 +1,193 @@
+/* pdbrecord_test.c - Checks the pdbrecord.h field decoders against libc
+
+Purpose: pdb_int() and pdb_float() must decode a field exactly as atoi()
+and atof() decode a NUL terminated copy of it, which is what the tools did
+before they read lines through pdbrecord.h
+Usage: ./pdbrecord_test [pdbfile ...]
+
+Every ATOM and HETATM line of the pdb files is checked, along with a fixed
+list of odd fields and a run of random ones. Any mismatch is printed and the
+exit status is 1.
+
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+Copyright 2005,2008 Fred P. Davis.
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+
+#include "pdbrecord.h"
+
+
+#define NUMRANDOMFIELDS 200000
+#define MAXFIELDWIDTH 12
+
+
+//FUNCTION DECLARATION
+int checkfield( const char *line, int len, int col, int width, const char *where ) ;
+
+int checkfile( const char *fn ) ;
+
+int checkodd( void ) ;
+
+int checkrandom( void ) ;
+
+
+
+int main(int argc, char *argv[])
+{
+   int numbad = 0 ;
+   int i ;
+
+   for (i = 1; i < argc; i++) {
+      numbad += checkfile(argv[i]) ; }
+
+   numbad += checkodd() ;
+   numbad += checkrandom() ;
+
+   if (numbad > 0) {
+      fprintf(stderr, "pdbrecord_test: %d fields decoded differently\n", numbad) ;
+      return 1 ;
+   }
+
+   return 0 ;
+}
+
+
+
+/* checkfield: decodes one field both ways; returns 1 on a mismatch. The
+   floats must be the same bits, so that -0 and 0 are told apart, except
+   that any NaN matches any other */
+int checkfield( const char *line, int len, int col, int width, const char *where )
+{
+   char field[MAXFIELDWIDTH + 64] ;
+   float got, want ;
+   int bad = 0 ;
+
+   pdb_copy(line, len, col, width, field) ;
+
+   if (pdb_int(line, len, col, width) != atoi(field)) {
+      fprintf(stderr, "%s: pdb_int(\"%s\") is %d, atoi() %d\n", where, field,
+              pdb_int(line, len, col, width), atoi(field)) ;
+      bad = 1 ;
+   }
+
+   got = pdb_float(line, len, col, width) ;
+   want = (float) atof(field) ;
+   if ((memcmp(&got, &want, sizeof(float)) != 0) &&
+       ! (isnan(got) && isnan(want))) {
+      fprintf(stderr, "%s: pdb_float(\"%s\") is %g, atof() %g\n", where, field,
+              got, want) ;
+      bad = 1 ;
+   }
+
+   return bad ;
+}
+
+
+
+/* checkfile: checks the numeric fields of every ATOM and HETATM line */
+int checkfile( const char *fn )
+{
+   pdbreader_t *fp ;
+   const char *line ;
+   int len ;
+   int numbad = 0 ;
+
+   fp = pdb_open(fn) ;
+   if (fp == NULL) {
+      fprintf(stderr, "ERROR: PDB file %s does not exist\n", fn) ;
+      exit(1) ;
+   }
+
+   while (pdb_nextline(fp, &line, &len)) {
+      if (! (pdb_is_atom(line, len) || pdb_is_hetatm(line, len))) {
+         continue ; }
+
+      numbad += checkfield(line, len, PDB_ATOMNO, fn) ;
+      numbad += checkfield(line, len, PDB_RESNO, fn) ;
+      numbad += checkfield(line, len, PDB_X, fn) ;
+      numbad += checkfield(line, len, PDB_Y, fn) ;
+      numbad += checkfield(line, len, PDB_Z, fn) ;
+      numbad += checkfield(line, len, PDB_OCCUP, fn) ;
+   }
+
+   pdb_close(fp) ;
+
+   return numbad ;
+}
+
+
+
+/* checkodd: fields seen in the wild or at the edges of the fast path,
+   each checked whole and cut short */
+int checkodd( void )
+{
+   static const char *odd[] = {
+      "", " ", "        ", "-", "+", " -  ", "-0", "-0.000", "  -.  ",
+      "  1.5e1 ", " 1.2E-01", "   .5   ", " 0x1p3  ", "0X1P3", "  nan   ",
+      " -nan", "  inf   ", "-Infinity", "1e", "1e+", ".e5", "12.5.3",
+      "1-2", "--1", "+-1", " \t 7.25", "007.500", "99999999", "-9999.999",
+      "1234567890123456", "0.1234567890123456789", "12345678.9012345678",
+      "1.5p3", "3,5", "4 5", "x1", "i", "N", NULL
+   } ;
+   int numbad = 0 ;
+   int len, cut ;
+   int i ;
+
+   for (i = 0; odd[i] != NULL; i++) {
+      len = strlen(odd[i]) ;
+      for (cut = 0; cut <= len; cut++) {
+         numbad += checkfield(odd[i], len, 0, cut, "odd field") ;
+         numbad += checkfield(odd[i], cut, 0, MAXFIELDWIDTH, "short line") ;
+      }
+   }
+
+   return numbad ;
+}
+
+
+
+/* checkrandom: fields made of the characters a numeric field can hold,
+   and a few it should not */
+int checkrandom( void )
+{
+   static const char chars[] = "          0123456789012345678901234567890..--+eEnNx\tai" ;
+   char field[MAXFIELDWIDTH] ;
+   int numbad = 0 ;
+   int width ;
+   int i, j ;
+
+   srand(1) ;
+   for (i = 0; i < NUMRANDOMFIELDS; i++) {
+      width = 1 + (rand() % MAXFIELDWIDTH) ;
+      for (j = 0; j < width; j++) {
+         field[j] = chars[rand() % (sizeof(chars) - 1)] ; }
+
+      numbad += checkfield(field, width, 0, width, "random field") ;
+   }
+
+   return numbad ;
+}
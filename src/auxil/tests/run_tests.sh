@@ -0,0 +1,196 @@
+#!/bin/sh
+# run_tests.sh - Checks the auxiliary programs against a corpus of PDB files
+#
+# Usage: sh run_tests.sh     (or `make test' in this directory)
+#
+# corpus/ holds the PDB files: 80 column records, the same with CRLF line
+# ends, short lines, blank and odd numeric fields, and alternate locations.
+# expected/ holds what the programs printed for them before they read PDB
+# files through common/pdbrecord.h; kdcontacts output is compared sorted,
+# as its order depends on the search. A CRLF file must give the same
+# output as its LF copy, and every file is also fed in gzip compressed.
+# altloc_filter is compared with altloc_filter.pl instead, over these files
+# and the odd occupancies, repeats and short lines of corpus/altloc_filter/,
+# and kdcontacts --subsets with subsets_rule.pl.
+#
+# Prints one line per check and exits 1 if any failed.
+
+cd "`dirname "$0"`" || exit 1
+
+LC_ALL=C
+export LC_ALL
+
+tmp=`mktemp -d` || exit 1
+trap 'rm -rf "$tmp"' 0
+
+failed=0
+
+# check name expected_file: compares $tmp/out with an expected file
+check () {
+   if cmp -s "$tmp/out" "$2" ; then
+      echo "ok      $1"
+   else
+      echo "FAILED  $1"
+      failed=1
+   fi
+}
+
+for pdb in corpus/*.pdb ; do
+   name=`basename "$pdb" .pdb`
+   case "$name" in
+      crlf) expected=expected/full80 ;;
+      *)    expected=expected/$name ;;
+   esac
+   gzip -c "$pdb" > "$tmp/$name.pdb.gz"
+
+   for input in "$pdb" "$tmp/$name.pdb.gz" ; do
+      case "$input" in
+         *.gz) what="$name (gzip)" ;;
+         *)    what="$name" ;;
+      esac
+
+      ../kdcontacts/kdcontacts 3 < "$input" 2>/dev/null | sort > "$tmp/out"
+      check "kdcontacts $what" "$expected.kdcontacts"
+
+      ../altloc_check/altloc_check < "$input" > "$tmp/out"
+      check "altloc_check $what" "$expected.altloc_check"
+
+      ../inscode_check/inscode_check < "$input" > "$tmp/out"
+      check "inscode_check $what" "$expected.inscode_check"
+
+      ../subset_extractor/subset_extractor "$input" < corpus/segments.txt \
+         > "$tmp/out" 2>/dev/null
+      check "subset_extractor $what" "$expected.subset_extractor"
+   done
+done
+
+# an mmCIF chain id too long to keep must stop kdcontacts, not be cut short
+if ../kdcontacts/kdcontacts < corpus/longchain.cif > /dev/null 2>&1 ; then
+   echo "FAILED  kdcontacts longchain.cif"
+   failed=1
+else
+   echo "ok      kdcontacts longchain.cif"
+fi
+
+# subset_extractor must read the same residues through a residue index, and
+# must not trust one left behind by another file of the same size and time
+cp corpus/full80.pdb "$tmp/indexed.pdb"
+../subset_extractor/subset_extractor --index "$tmp/indexed.pdb"
+../subset_extractor/subset_extractor "$tmp/indexed.pdb" < corpus/segments.txt \
+   > "$tmp/out" 2>/dev/null
+check "subset_extractor full80 (indexed)" expected/full80.subset_extractor
+touch -r "$tmp/indexed.pdb" "$tmp/stamp"
+sed 's/^\(ATOM.\{17\}\)A/\1Z/' corpus/full80.pdb > "$tmp/indexed.pdb"
+touch -r "$tmp/stamp" "$tmp/indexed.pdb"
+if ../subset_extractor/subset_extractor "$tmp/indexed.pdb" < corpus/segments.txt \
+      2>&1 >/dev/null | grep -q 'does not match its residue index' ; then
+   echo "ok      subset_extractor stale index"
+else
+   echo "FAILED  subset_extractor stale index"
+   failed=1
+fi
+
+# an ATOM line that ends before the altloc or insertion code column has
+# neither, as if it were padded out with blanks
+printf 'ATOM      1  N  \nATOM      2  CA\nATOM      3  C   SER A  38\n' \
+   > "$tmp/cutshort.pdb"
+for tool in altloc_check inscode_check ; do
+   ../$tool/$tool < "$tmp/cutshort.pdb" > "$tmp/out"
+   echo 0 > "$tmp/want"
+   check "$tool cut short lines" "$tmp/want"
+done
+../pdb_features/pdb_features "$tmp/cutshort.pdb" | grep '^altloc\|^inscode' \
+   > "$tmp/out"
+printf 'altloc=0\ninscode=0\n' > "$tmp/want"
+check "pdb_features cut short lines" "$tmp/want"
+
+# a gzip file cut short must fail, not pass for a smaller structure
+gzip -c corpus/full80.pdb | head -c 3000 > "$tmp/cut.pdb.gz"
+for tool in kdcontacts altloc_check inscode_check ; do
+   if ../$tool/$tool < "$tmp/cut.pdb.gz" > /dev/null 2>&1 ; then
+      echo "FAILED  $tool cut short (gzip)"
+      failed=1
+   else
+      echo "ok      $tool cut short (gzip)"
+   fi
+done
+if ../subset_extractor/subset_extractor "$tmp/cut.pdb.gz" \
+      < corpus/segments.txt > /dev/null 2>&1 ||
+   ../subset_extractor/subset_extractor --index "$tmp/cut.pdb.gz" \
+      > /dev/null 2>&1 ||
+   ../altloc_filter/altloc_filter "$tmp/cut.pdb.gz" > /dev/null 2>&1 ; then
+   echo "FAILED  subset_extractor, altloc_filter cut short (gzip)"
+   failed=1
+else
+   echo "ok      subset_extractor, altloc_filter cut short (gzip)"
+fi
+printf 'cut\t%s\n' "$tmp/cut.pdb.gz" > "$tmp/manifest"
+../kdcontacts/kdcontacts --batch "$tmp/manifest" 2>/dev/null |
+   grep -c '^#batch_error	cut	' > "$tmp/out"
+echo 1 > "$tmp/want"
+check "kdcontacts --batch cut short (gzip)" "$tmp/want"
+
+# a misspelt option or radius must stop kdcontacts, not be read as a radius
+for args in "--residue-pair" "3x" ; do
+   if ../kdcontacts/kdcontacts $args < corpus/full80.pdb > /dev/null 2>&1 ; then
+      echo "FAILED  kdcontacts $args"
+      failed=1
+   else
+      echo "ok      kdcontacts $args"
+   fi
+done
+
+# altloc_filter must print what altloc_filter.pl prints, and fail where it
+# dies; both read the file twice, so the gzip copy is given by name
+if perl -e 1 2>/dev/null ; then
+   for pdb in corpus/*.pdb corpus/altloc_filter/*.pdb ; do
+      name=`basename "$pdb" .pdb`
+      gzip -c "$pdb" > "$tmp/$name.pdb.gz"
+      if perl ../altloc_filter/altloc_filter.pl "$pdb" > "$tmp/perl.out" 2>/dev/null
+      then perlstatus=ok ; else perlstatus=died ; fi
+
+      for input in "$pdb" "$tmp/$name.pdb.gz" ; do
+         case "$input" in
+            *.gz) what="$name (gzip)" ;;
+            *)    what="$name" ;;
+         esac
+
+         if ../altloc_filter/altloc_filter "$input" > "$tmp/out" 2>/dev/null
+         then status=ok ; else status=died ; fi
+
+         if [ "$status" = "$perlstatus" ] ; then
+            check "altloc_filter $what" "$tmp/perl.out"
+         else
+            echo "FAILED  altloc_filter $what ($status, perl $perlstatus)"
+            failed=1
+         fi
+      done
+   done
+else
+   echo "skipped altloc_filter, no perl"
+fi
+
+# kdcontacts --subsets must keep the residue pairs calc/interfaces.pm keeps;
+# corpus/subsets.txt puts residues in one subset, in two, and in the same
+# subset twice
+if perl -e 1 2>/dev/null ; then
+   ../kdcontacts/kdcontacts --residue-pairs < corpus/full80.pdb 2>/dev/null |
+      perl subsets_rule.pl corpus/subsets.txt | sort > "$tmp/perl.out"
+   for engine in kdtree grid ; do
+      ../kdcontacts/kdcontacts --residue-pairs --engine $engine \
+         --subsets corpus/subsets.txt < corpus/full80.pdb 2>/dev/null |
+         sort > "$tmp/out"
+      check "kdcontacts --subsets ($engine)" "$tmp/perl.out"
+   done
+else
+   echo "skipped kdcontacts --subsets, no perl"
+fi
+
+if ./pdbrecord_test corpus/*.pdb ; then
+   echo "ok      pdbrecord_test"
+else
+   echo "FAILED  pdbrecord_test"
+   failed=1
+fi
+
+exit $failed
@@ -0,0 +1,115 @@
+#!/usr/local/bin/perl
+=head1 NAME
+
+subsets_rule.pl - applies the calc/interfaces.pm subset rule to
+kdcontacts --residue-pairs output
+
+=head1 DESCRIPTION
+
+Reads the residue pairs of a whole structure on STDIN and prints those an
+interface calculation keeps for the given subset assignment: at least one
+residue is assigned, and the two residues' sorted lists of subsets
+(repeats included) differ. The assignment is read as calc/interfaces.pm
+reads subsets_residues, so that the output can be compared with
+kdcontacts --residue-pairs --subsets.
+
+=head1 SYNOPSIS
+
+B<subsets_rule.pl> assignfile < residue_pairs
+
+=head1 AUTHOR
+
+Fred P. Davis, HHMI-JFRC (davisf@janelia.hhmi.org)
+
+=head1 LICENCE AND COPYRIGHT
+
+Copyright 2008 Fred P. Davis (davisf@janelia.hhmi.org).
+See the file COPYING for copying permission.
+
+This file is part of PIBASE.
+
+PIBASE is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+PIBASE is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with PIBASE.  If not, see <http://www.gnu.org/licenses/>.
+
+=cut
+
+
+use warnings;
+use strict ;
+
+main() ;
+
+=head2 SUB main()
+
+=cut
+
+sub main {
+
+   my $usage = "usage: subsets_rule.pl assignfile < residue_pairs" ;
+   if ($#ARGV < 0 ) { die $usage."\n" ;}
+   my $assign_fn = $ARGV[0] ;
+
+   my $subset_id_2_index ;
+   my $subset_assign ;
+   open (ASSIGNF, $assign_fn) or die "can not open $assign_fn\n" ;
+   while (my $line = <ASSIGNF>) {
+      chomp $line;
+      if (($line =~ /^#/) || ($line eq '')) { next; }
+
+      my ($chain_id, $resno, $subset_id) = split(/\t/, $line) ;
+      if ($chain_id eq '') {
+         $chain_id = ' '; }
+      $resno =~ s/ //g ;
+
+      if (!exists $subset_id_2_index->{$subset_id}) {
+         $subset_id_2_index->{$subset_id} =
+            scalar(keys %{$subset_id_2_index}) ; }
+
+      my $sig = $resno."\n".$chain_id ;
+      push @{$subset_assign->{$sig}}, $subset_id_2_index->{$subset_id} ;
+   }
+   close(ASSIGNF) ;
+
+   my $subset_assign_flat ;
+   foreach my $t_sig (keys %{$subset_assign}) {
+      my @t = @{$subset_assign->{$t_sig}} ;
+      my @sort_t = sort{$a <=> $b} @t ;
+      $subset_assign_flat->{$t_sig} = join(',', @sort_t) ;
+   }
+
+   while (my $line = <STDIN>) {
+      if ($line =~ /^#/) {
+         print $line ;
+         next;
+      }
+
+      my @f = split(/\t/, $line) ;
+      my $sig1 = $f[0]."\n".$f[1] ;
+      my $sig2 = $f[3]."\n".$f[4] ;
+
+      my ($in1, $in2) = (0, 0);
+      if (exists $subset_assign_flat->{$sig1}) {
+         $in1 = 1; }
+      if (exists $subset_assign_flat->{$sig2}) {
+         $in2 = 1; }
+
+      my $isdiff =1  ;
+      if ((($in1 + $in2) == 2) &&
+          ($subset_assign_flat->{$sig1} eq $subset_assign_flat->{$sig2})) {
+         $isdiff = 0; }
+
+      if ((($in1 + $in2) > 0) && $isdiff) {
+         print $line ; }
+   }
+
+}
@@ -1370,7 +1370,7 @@ sub mysql_commandline_query {
 
    Function:    Returns location of binaries used in PIBASE associated activities
    Return:	$_->{program} = program location.
-      perl, zcat, rigor, subset_extractor, altloc_check
+      perl, zcat, rigor, subset_extractor, altloc_check, pdb_features
    Args:        none
 
 =cut
@@ -1436,13 +1436,18 @@ sub locate_binaries {
    }
 
 
+# the C altloc_filter prints the same as the perl script, only faster
    $binaries->{'altloc_filter'} = "$rootdir/auxil/".
-      "altloc_filter/altloc_filter.pl" ;
+      "altloc_filter/altloc_filter.$mach" ;
    if (! -e $binaries->{'altloc_filter'}) {
-      $binaries->{'altloc_filter'} = "ERROR" ;
-   } else {
-      $binaries->{'altloc_filter'} = $binaries->{perl}." ".
-         $binaries->{'altloc_filter'} ;
+      $binaries->{'altloc_filter'} = "$rootdir/auxil/".
+         "altloc_filter/altloc_filter.pl" ;
+      if (! -e $binaries->{'altloc_filter'}) {
+         $binaries->{'altloc_filter'} = "ERROR" ;
+      } else {
+         $binaries->{'altloc_filter'} = $binaries->{perl}." ".
+            $binaries->{'altloc_filter'} ;
+      }
    }
 
 
@@ -1453,6 +1458,13 @@ sub locate_binaries {
    }
 
 
+   $binaries->{'pdb_features'} = "$rootdir/auxil/".
+      "pdb_features/pdb_features.$mach" ;
+   if (! -e $binaries->{'pdb_features'}) {
+      $binaries->{'pdb_features'} = "ERROR" ;
+   }
+
+
    $binaries->{'ccp4sc'} = "$rootdir/auxil/ccp4sc/ccp4sc.$mach" ;
    if (! -e $binaries->{'ccp4sc'}) {
       $binaries->{'ccp4sc'} = "ERROR" ;
@@ -47,7 +47,7 @@ use Carp ;
 
 require Exporter;
 our @ISA = qw/Exporter/ ;
-our @EXPORT = qw/altloc_check altloc_filter pdb_clean_entries_idx/ ;
+our @EXPORT = qw/altloc_check altloc_filter pdb_features pdb_clean_entries_idx/ ;
 
 use pibase qw/locate_binaries/;
 use File::Temp qw/tempdir tempfile/ ;
@@ -83,6 +83,51 @@ sub altloc_check {
 }
 
 
+=head2 pdb_features()
+
+   Title:       pdb_features()
+   Function:    reads a PDB file once for what the pipeline needs to know
+      before working on it
+   Args:        $_ = pdb filename
+   Return:      $_->{feature} = value, as printed by the pdb_features binary:
+      altloc, inscode, atoms, residues, chains, hetatms, models and the
+      coordinate bounds xmin .. zmax. If pdb_features has not been built,
+      only altloc and inscode are given, by altloc_check and inscode_check
+
+=cut
+
+sub pdb_features {
+
+   my $pdb_fn = shift ;
+
+   my $binaries = pibase::locate_binaries() ;
+
+   if (! -e $pdb_fn) {
+      croak("Error: $pdb_fn not found") ; }
+
+   my $features = {} ;
+   if ($binaries->{'pdb_features'} ne 'ERROR') {
+      my @report = `$binaries->{pdb_features} < $pdb_fn` ;
+      foreach my $line (@report) {
+         chomp $line ;
+         my ($feature, $value) = split(/=/, $line, 2) ;
+         $features->{$feature} = $value ;
+      }
+
+   } else {
+      $features->{altloc} = altloc_check($pdb_fn) ;
+
+      if ($binaries->{'inscode_check'} ne 'ERROR') {
+         $features->{inscode} = `$binaries->{inscode_check} < $pdb_fn` ;
+         chomp $features->{inscode} ;
+      }
+   }
+
+   return $features ;
+
+}
+
+
 =head2 altloc_filter()
 
    Title:       altloc_filter()
@@ -41,7 +41,7 @@ use warnings;
 use Exporter;
 use Carp ;
 our @ISA = qw/Exporter/ ;
-our @EXPORT = qw/subset_extract/ ;
+our @EXPORT = qw/subset_extract subset_extract_multi subset_index/ ;
 
 use pibase qw/locate_binaries/ ;
 use File::Temp qw/tempfile/ ;
@@ -74,16 +74,10 @@ sub subset_extract {
 
    my $binaries = pibase::locate_binaries() ;
 
-   my ($temp_fh, $localbdp) = tempfile(SUFFIX => ".pdb") ; close($temp_fh) ;
-   if ($pdb_fn =~ /\.gz$/) {
-      my $tcom = $binaries->{zcat}." $pdb_fn > ".$localbdp ;
-      system($tcom) ;
-   } else {
-      pibase::safe_copy($pdb_fn, $localbdp) ;
-   }
-
-   if (!-e $localbdp) {
-      return {error_fl => "ERROR: pdb file access error - couldnt copy locally"}; }
+# subset_extractor reads gzip files itself, and uses a residue index left
+# next to the PDB file by subset_index()
+   if (!-e $pdb_fn) {
+      return ["ERROR: pdb file access error - $pdb_fn not found"]; }
 
 
    my $errors ;
@@ -109,7 +103,7 @@ sub subset_extract {
    }
    close ($subsetdef_fh) ;
 
-   my $tcom = "$binaries->{subset_extractor} $localbdp < $subsetdef_fn 2> $errfile_fn >$cutpdb_fn" ;
+   my $tcom = "$binaries->{subset_extractor} $pdb_fn < $subsetdef_fn 2> $errfile_fn >$cutpdb_fn" ;
    system($tcom) ;
    if ($compress_out_fl) {
       system("gzip ".$cutpdb_fn) ;
@@ -123,11 +117,109 @@ sub subset_extract {
       unlink $errfile_fn ;
    }
 
-   {
-      my ($newdev, $newino) = stat($localbdp) ;
-      my ($olddev, $oldino) = stat($pdb_fn) ;
-      if ($newdev != $olddev || $newino != $oldino) {
-         unlink $localbdp ; }
+   return $errors ;
+
+}
+
+
+=head2 SUB subset_extract_multi()
+
+   Function: extracts several subsets of one PDB file, in a single pass
+             of subset_extractor over it
+   Args:        $_->{in_fn} = PDB file name, may be gzip compressed
+                $_->{subsets}->[i] = {
+                   subset_id => subset identifier
+                   out_fn => output PDB file name, gzip compressed if .gz
+                   chain => arrayref of chain identifiers
+                   start => arrayref of start residue numbers
+                   end => arrayref of end residue numbers
+                }
+
+   Returns:     $_->[i] arrayref of errors
+
+   Files IN:    PDB file ($_->{in_fn})
+   Files OUT:   subset PDB files ($_->{subsets}->[i]->{out_fn})
+
+=cut
+
+sub subset_extract_multi {
+
+   my $in = shift ;
+   my $pdb_fn = $in->{in_fn} ;
+
+   my $binaries = pibase::locate_binaries() ;
+
+   if ($binaries->{'subset_extractor'} eq 'ERROR') {
+      croak("ERROR subset_extract_multi(): subset_extractor binary not found") ; }
+
+   if (!-e $pdb_fn) {
+      return ["ERROR: pdb file access error - $pdb_fn not found"]; }
+
+   my ($manifest_fh, $manifest_fn) = tempfile("subsetmanifest.XXXXXX") ;
+   my $errfile_fn = $manifest_fn.".err" ;
+
+   foreach my $subset (@{$in->{subsets}}) {
+      if ($pdb_fn eq $subset->{out_fn}) {
+         croak("ERROR subset_extract_multi(): the original and cut pdb filenames are the same") ; }
+
+      foreach my $j ( 0 .. $#{$subset->{chain}} ) {
+         my @outvals = ($subset->{subset_id}, $subset->{out_fn},
+                        $subset->{chain}->[$j], $subset->{start}->[$j],
+                        $subset->{end}->[$j]) ;
+         print $manifest_fh join("\t", @outvals)."\n" ;
+      }
+   }
+   close ($manifest_fh) ;
+
+   my $tcom = "$binaries->{subset_extractor} --manifest $manifest_fn $pdb_fn 2> $errfile_fn" ;
+   system($tcom) ;
+   unlink $manifest_fn ;
+
+   my $errors ;
+   if (-s $errfile_fn) {
+      push @{$errors}, "subset_extractor error, see: $errfile_fn" ;
+   } else {
+      unlink $errfile_fn ;
+   }
+
+   return $errors ;
+
+}
+
+
+=head2 SUB subset_index()
+
+   Function: indexes the residues of a PDB file, so that later subset
+             extractions from it read only the residues they need
+   Args:        $_->{in_fn} = PDB file name, may be gzip compressed
+
+   Returns:     $_->[i] arrayref of errors
+
+   Files IN:    PDB file ($_->{in_fn})
+   Files OUT:   residue index ($_->{in_fn}.ridx)
+
+=cut
+
+sub subset_index {
+
+   my $in = shift ;
+   my $pdb_fn = $in->{in_fn} ;
+
+   my $binaries = pibase::locate_binaries() ;
+
+   if ($binaries->{'subset_extractor'} eq 'ERROR') {
+      croak("ERROR subset_index(): subset_extractor binary not found") ; }
+
+   if (!-e $pdb_fn) {
+      return ["ERROR: pdb file access error - $pdb_fn not found"]; }
+
+   my $tcom = "$binaries->{subset_extractor} --index $pdb_fn 2>&1" ;
+   my $tout = `$tcom` ;
+
+   my $errors ;
+   if ($tout ne '') {
+      chomp $tout ;
+      push @{$errors}, "subset_extractor --index error: $tout" ;
    }
 
    return $errors ;
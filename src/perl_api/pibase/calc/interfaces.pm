@@ -50,6 +50,7 @@ use Sys::Hostname qw/hostname/;
 
 use pibase::ASTRAL ;
 use pibase::kdcontacts ;
+use pibase::PDB qw/pdb_features/ ;
 use pibase::interatomic_contacts qw/contacts_select contacts_select_inter special_contact raw_contacts_select/;
 
 
@@ -774,7 +775,6 @@ sub _interface_detect_BUG_inscode_calc__calc_res_pairs {
 
    my $binaries = pibase::locate_binaries() ;
    my $kdcontacts_bin = $binaries->{'kdcontacts'}." $kdcontacts_radius" ;
-   my $altloc_check = $binaries->{'altloc_check'} ;
    my $altloc_filter = $binaries->{'altloc_filter'} ;
 
    my $bdp_file_path = $params->{bdp_path} ;
@@ -794,7 +794,7 @@ sub _interface_detect_BUG_inscode_calc__calc_res_pairs {
 
 # Check if the pdb file contains altloc identifiers. If so, first filter with altloc_filter.pl
 
-   my $altloc_fl = `$altloc_check < $localbdp` ; chomp $altloc_fl ;
+   my $altloc_fl = pdb_features($localbdp)->{altloc} ;
    my $tcom ;
    if ($altloc_fl) {
       $tcom = "$altloc_filter $localbdp" ;
@@ -1771,7 +1771,6 @@ sub _interface_detect_calc__calc_res_pairs {
 
    my $binaries = pibase::locate_binaries() ;
    my $kdcontacts_bin = $binaries->{'kdcontacts'}." $kdcontacts_radius" ;
-   my $altloc_check = $binaries->{'altloc_check'} ;
    my $altloc_filter = $binaries->{'altloc_filter'} ;
 
    my $bdp_file_path = $params->{bdp_path} ;
@@ -1795,7 +1794,7 @@ sub _interface_detect_calc__calc_res_pairs {
       tempfile("kdcontacts.$host.XXXXXX", SUFFIX => ".err"); close($fh2) ;
 
 # Check if the pdb file contains altloc identifiers. If so, first filter with altloc_filter.pl
-   my $altloc_fl = `$altloc_check < $localbdp` ; chomp $altloc_fl ;
+   my $altloc_fl = pdb_features($localbdp)->{altloc} ;
    my $tcom ;
    if ($altloc_fl) {
       $tcom = "$altloc_filter $localbdp" ;
@@ -1869,7 +1868,6 @@ sub _interface_detect__calc_interatomic_contacts {
 
    my $binaries = pibase::locate_binaries() ;
    my $kdcontacts_bin = $binaries->{'kdcontacts'}." $kdcontacts_radius" ;
-   my $altloc_check = $binaries->{'altloc_check'} ;
    my $altloc_filter = $binaries->{'altloc_filter'} ;
 
    my $bdp_file_path = $params->{bdp_path} ;
@@ -1889,7 +1887,7 @@ sub _interface_detect__calc_interatomic_contacts {
 
 # Check if the pdb file contains altloc identifiers. If so, first filter with altloc_filter.pl
 
-   my $altloc_fl = `$altloc_check < $localbdp` ; chomp $altloc_fl ;
+   my $altloc_fl = pdb_features($localbdp)->{altloc} ;
    my $tcom ;
    if ($altloc_fl) {
       $tcom = "$altloc_filter $localbdp" ;
@@ -41,7 +41,7 @@ our @ISA = qw/Exporter/ ;
 our @EXPORT = qw/bdp_path_2_id maketable_bdp_files create_subset_pdbs/ ;
 
 use pibase qw/connect_pibase mysql_hashload mysql_fetchcols mysql_hasharrload safe_move sid_2_domdir/;
-use pibase::PDB::subsets qw/subset_extract/;
+use pibase::PDB::subsets qw/subset_extract subset_extract_multi subset_index/;
 use File::Temp qw/tempfile tempdir/ ;
 use File::Path qw/mkpath/ ;
 use File::Basename ;
@@ -90,6 +90,7 @@ sub bdp_path_2_id {
                   3. pisa file - base name
                   4. pdb_id
                   5. '0'
+                foreach bdp file: <bdp file path>.ridx, per index_bdp_file()
 
 =cut
 
@@ -117,6 +118,11 @@ sub maketable_bdp_files {
    }
    open($fh->{out}, ">".$fn->{out}) ;
 
+# Every BDP file gets a residue index, so that create_subset_pdbs() reads only
+# the residues of its domains; without subset_extractor they are read whole
+   my $binaries = pibase::locate_binaries() ;
+   my $index_fl = ($binaries->{'subset_extractor'} ne 'ERROR') ;
+
 # Load experiment type entries from pibase.pdb_entry_type.
    my $experiment = pibase::mysql_hashload($dbh,
       'SELECT pdb_id, experiment_type FROM pdb_entry_type');
@@ -157,7 +163,10 @@ sub maketable_bdp_files {
          my $full_path = $pibase_specs->{pdbnmr_dir}."/".substr($pdb_id,1,2).'/'.
                          $modelpdb ;
          if (!-s $full_path) {
-            print STDERR "ERROR: PDB_NMR $pdb_id not found in $full_path\n"; }
+            print STDERR "ERROR: PDB_NMR $pdb_id not found in $full_path\n";
+         } elsif ($index_fl) {
+            index_bdp_file($full_path) ;
+         }
 
          my @outvals = ('0', $full_path, $modelpdb, $pdb_id, '1') ;
          print {$fh->{out}} join("\t", @outvals)."\n" ;
@@ -170,6 +179,8 @@ sub maketable_bdp_files {
          if (-e $full_path) {
             my @outvals = ('0', $full_path, $pdbfile , $pdb_id, '1') ;
             print {$fh->{out}} join("\t", @outvals)."\n" ;
+            if ($index_fl) {
+               index_bdp_file($full_path) ; }
          } else {
             print STDERR "ERROR: PDB $pdb_id not found in $full_path\n" ;
          }
@@ -190,6 +201,8 @@ sub maketable_bdp_files {
 
             if (-s $pisa_path) {
                print {$fh->{out}} join("\t", @outvals)."\n" ;
+               if ($index_fl) {
+                  index_bdp_file($pisa_path) ; }
             } else {
                if (!-s $pisa_path && -e $pisa_path) {
                   print STDERR "ERROR: PISA $pdb2pisa->{$pdb_id}->[$k] is empty ".
@@ -217,12 +230,40 @@ sub maketable_bdp_files {
 }
 
 
+=head2 index_bdp_file()
+
+   Title:       index_bdp_file()
+   Function:    writes the residue index of a BDP file, reporting failures
+                  on STDERR; subset extraction works without the index
+   Args:        $_ = bdp file path
+   Returns:     nothing
+   Files out:   <bdp file path>.ridx
+
+=cut
+
+sub index_bdp_file {
+
+   my $bdp_path = shift ;
+
+   my $index_errors = pibase::PDB::subsets::subset_index({
+      in_fn => $bdp_path
+   }) ;
+
+   if (defined $index_errors) {
+      foreach my $j ( 0 .. $#{$index_errors}) {
+         print STDERR "ERROR: $bdp_path: ".
+            "pibase::subsets::subset_index(): $index_errors->[$j]\n" ; }
+   }
+
+}
+
+
 =head2 create_subset_pdbs()
 
    Title:       create_subset_pdbs()
    OLD NAME:    cutdom_calc()
    Function:    extracts list of domains from their source PDB files,
-                  calling subset_extract()
+                  calling subset_extract_multi() once per source file
    Args:        none
    Returns:     nothing
    STDIN:       tabbed: bdp_file_path, domain_id (subset_id), domain definition
@@ -441,25 +482,17 @@ rmdir \$scratchdir\n" ;
       chdir $tempdir ;
       my (@movethese, @movedest) ;
 
+      my $bdp2sids = {} ;
       foreach my $sid (sort keys %{$sid2def}) {
+         push @{$bdp2sids->{$sid2bdp_path->{$sid}}}, $sid ; }
 
-         my $bdp_path = $sid2bdp_path->{$sid} ;
+# all domains of a BDP file are cut out in one pass of subset_extractor
+      foreach my $bdp_path (sort keys %{$bdp2sids}) {
 
-         my $chain = $sid2def->{$sid}->{chain} ;
-         my $start= $sid2def->{$sid}->{start} ;
-         my $end= $sid2def->{$sid}->{end} ;
+# the auxil binaries read gzip files themselves, so subset_extractor gets the
+# BDP file itself, and its residue index, unless altlocs are filtered out
          my $cur_fn = $bdp_path;
    
-         my ($compress_fl, $unc_fh, $unc_fn) ;
-
-         if ($bdp_path =~ /\.gz$/) {
-            $compress_fl = 1;
-            ($unc_fh, $unc_fn) = tempfile() ; close($unc_fh) ;
-            system("$binaries->{zcat} $cur_fn > $unc_fn") ;
-            $cur_fn = $unc_fn ;
-         }
-   
-   
          my $altloc_fl = `$binaries->{altloc_check} < $cur_fn` ;
          chomp $altloc_fl ;
    
@@ -470,44 +503,52 @@ rmdir \$scratchdir\n" ;
             print STDERR "note: $bdp_path has an altloc set, now filtering: ." ;
             system("$binaries->{altloc_filter} $cur_fn > $t_fn") ;
             print STDERR "\bx\n" ;
-            if ($compress_fl) {unlink $unc_fn;}
             $cur_fn = $t_fn ;
          }
    
+         my @subsets ;
+         foreach my $sid (@{$bdp2sids->{$bdp_path}}) {
 #changed post-build 080825_0747         my $cutpdb_fn = "$sid.pdb" ;
-         my $cutpdb_fn = "$sid.pdb.gz" ;
+            push @subsets, {
+               subset_id => $sid,
+               out_fn => "$sid.pdb.gz",
+               chain => $sid2def->{$sid}->{chain},
+               start => $sid2def->{$sid}->{start},
+               end => $sid2def->{$sid}->{end}
+            } ;
+         }
 
-         my $extract_errors = pibase::PDB::subsets::subset_extract({
+         my $extract_errors = pibase::PDB::subsets::subset_extract_multi({
             in_fn => $cur_fn,
-            out_fn => $cutpdb_fn,
-            chain => $chain,
-            start => $start,
-            end => $end
+            subsets => \@subsets
          }) ;
    
-         if ($#{$extract_errors} >= 0 ) {
-            foreach my $j ( 0 .. $#{$extract_errors}) {
+         foreach my $subset (@subsets) {
+            my $sid = $subset->{subset_id} ;
+            my $cutpdb_fn = $subset->{out_fn} ;
+
+            if ($#{$extract_errors} >= 0 ) {
+               foreach my $j ( 0 .. $#{$extract_errors}) {
+                  print STDERR "ERROR: $bdp_path, extract $sid: ".
+                  "pibase::subsets::subset_extract_multi(): $extract_errors->[$j]\n" ;
+               }
+            } elsif (-z $cutpdb_fn) {
                print STDERR "ERROR: $bdp_path, extract $sid: ".
-               "pibase::subsets::subset_extract(): $extract_errors->[$j]\n" ;
+                            "empty subset extract pdb file\n" ;
+               unlink $cutpdb_fn ;
+            } else {
+               my $deposit_dir = pibase::sid_2_domdir($sid) ;
+               push @movethese, $cutpdb_fn ;
+               push @movedest, $deposit_dir;
+               print "$sid\t$deposit_dir/$cutpdb_fn\n" ;
             }
-         } elsif (-z $cutpdb_fn) {
-            print STDERR "ERROR: $bdp_path, extract $sid: ".
-                         "empty subset extract pdb file\n" ;
-            unlink $cutpdb_fn ;
-         } else {
-            my $deposit_dir = pibase::sid_2_domdir($sid) ;
-            push @movethese, $cutpdb_fn ;
-            push @movedest, $deposit_dir;
-            print "$sid\t$deposit_dir/$cutpdb_fn\n" ;
          }
    
          if ( ($altloc_fl) && ($bdp_path ne $cur_fn) ) {
             unlink $cur_fn;
          }
-
-         if ($compress_fl) { unlink $unc_fn;}
    
-         if ( $#movethese == $movethreshold ) {
+         if ( $#movethese >= $movethreshold ) {
             foreach my $j ( 0 .. $#movethese) {
                if (! -d $movedest[$j]) {
                   mkpath($movedest[$j]) ;}
@@ -46,6 +46,7 @@ use pibase::modeller qw/calc_sasa/ ;
 use pibase::PDB::chains qw/chain_info/;
 use pibase::PDB::residues qw/residue_info/;
 use pibase::PDB::sec_strx qw/run_dssp parse_dssp/;
+use pibase::PDB qw/pdb_features/ ;
 use pibase::residue_math qw/residue_int residue_add residue_inrange/;
 use pibase::calc::interfaces qw/_interface_detect_calc__calc_res_pairs/ ;
 use pibase::specs ;
@@ -7262,7 +7263,6 @@ sub int_sc_calc_main {
 
    my $modeller_bin = "modSVN" ;
    my $binaries = pibase::locate_binaries() ;
-   my $altloc_check = $binaries->{'altloc_check'} ;
    my $altloc_filter = $binaries->{'altloc_filter'} ;
 
    my $usage = "perl ".__FILE__." < bdpid_list" ;
@@ -7340,7 +7340,7 @@ sub int_sc_calc_main {
             next;
          }
 
-         my $altloc_fl = `$altloc_check < $pairpdb_fn` ; chomp $altloc_fl ;
+         my $altloc_fl = pdb_features($pairpdb_fn)->{altloc} ;
          if ($altloc_fl) {
             print STDERR "NOTE: ($bdp) $sid1 - $sid2 altloc filtering\n" ;
             my ($tfh, $tfn) = tempfile("altloctemp.XXXXX",SUFFIX=>".pdb") ;